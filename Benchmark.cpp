@@ -0,0 +1,287 @@
+#include <iostream>
+#include <new>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "gc.h"
+
+// Benchmarks of GCPtr against raw pointers and std::shared_ptr.
+// Each result is written as one CSV row:
+//
+//     benchmark,impl,n,seconds,ns_per_op
+//
+// or, with --json as an argument, as one JSON object per line.
+// A number as an argument scales the work done by every benchmark.
+
+// A small object to allocate
+class Payload {
+
+public:
+    int val;
+    double pad[3];
+
+    Payload(int v = 0) {
+        val = v;
+    }
+};
+
+// Keeps results alive so the compiler cannot drop the work
+volatile long sink;
+
+bool json = false;
+
+// Write one result
+void report(const char *benchmark, const char *impl, size_t n,
+            std::chrono::steady_clock::time_point start) {
+
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    double ns = elapsed.count() * 1e9 / n;
+
+    if (json) {
+        std::cout << "{\"benchmark\":\"" << benchmark << "\",\"impl\":\""
+        << impl << "\",\"n\":" << n << ",\"seconds\":" << elapsed.count()
+        << ",\"ns_per_op\":" << ns << "}\n";
+    } else {
+        std::cout << benchmark << "," << impl << "," << n << ","
+        << elapsed.count() << "," << ns << "\n";
+    }
+}
+
+std::chrono::steady_clock::time_point now() {
+    return std::chrono::steady_clock::now();
+}
+
+// Create and destroy n objects
+void constructDestroy(size_t n) {
+
+    std::chrono::steady_clock::time_point start = now();
+    for (size_t i = 0; i < n; ++i) {
+        Payload *p = new Payload((int) i);
+        sink = p->val;
+        delete p;
+    }
+    report("construct_destroy", "raw", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        std::shared_ptr<Payload> p = std::make_shared<Payload>((int) i);
+        sink = p->val;
+    }
+    report("construct_destroy", "shared_ptr", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        GCPtr<Payload> p = make_gc<Payload>((int) i);
+        sink = p->val;
+    }
+    report("construct_destroy", "gcptr", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        GCPtr<Payload> p = new Payload((int) i);
+        sink = p->val;
+    }
+    report("construct_destroy", "gcptr_new", n, start);
+}
+
+// Copy a pointer n times, destroying each copy
+void copy(size_t n) {
+
+    Payload *raw = new Payload(1);
+    std::chrono::steady_clock::time_point start = now();
+    for (size_t i = 0; i < n; ++i) {
+        Payload *c = raw;
+        sink = c->val;
+    }
+    report("copy", "raw", n, start);
+    delete raw;
+
+    std::shared_ptr<Payload> shared = std::make_shared<Payload>(1);
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        std::shared_ptr<Payload> c = shared;
+        sink = c->val;
+    }
+    report("copy", "shared_ptr", n, start);
+
+    GCPtr<Payload> gc = make_gc<Payload>(1);
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        GCPtr<Payload> c = gc;
+        sink = c->val;
+    }
+    report("copy", "gcptr", n, start);
+}
+
+// Assign one of two pointers to a third n times
+void assign(size_t n) {
+
+    Payload *rawA = new Payload(1), *rawB = new Payload(2), *raw = NULL;
+    std::chrono::steady_clock::time_point start = now();
+    for (size_t i = 0; i < n; ++i) {
+        raw = i % 2 ? rawA : rawB;
+        sink = raw->val;
+    }
+    report("assign", "raw", n, start);
+    delete rawA;
+    delete rawB;
+
+    std::shared_ptr<Payload> sharedA = std::make_shared<Payload>(1);
+    std::shared_ptr<Payload> sharedB = std::make_shared<Payload>(2);
+    std::shared_ptr<Payload> shared;
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        shared = i % 2 ? sharedA : sharedB;
+        sink = shared->val;
+    }
+    report("assign", "shared_ptr", n, start);
+
+    GCPtr<Payload> gcA = make_gc<Payload>(1);
+    GCPtr<Payload> gcB = make_gc<Payload>(2);
+    GCPtr<Payload> gc;
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        gc = i % 2 ? gcA : gcB;
+        sink = gc->val;
+    }
+    report("assign", "gcptr", n, start);
+}
+
+// Free n unreferenced objects at once. For GCPtr this is the latency
+// of one collect(); the baselines delete or release the same number.
+void collectLatency(size_t n) {
+
+    std::vector<Payload *> raws(n);
+    for (size_t i = 0; i < n; ++i) raws[i] = new Payload((int) i);
+    std::chrono::steady_clock::time_point start = now();
+    for (size_t i = 0; i < n; ++i) delete raws[i];
+    report("collect", "raw", n, start);
+
+    std::vector<std::shared_ptr<Payload> > shared(n);
+    for (size_t i = 0; i < n; ++i) shared[i] = std::make_shared<Payload>((int) i);
+    start = now();
+    shared.clear();
+    report("collect", "shared_ptr", n, start);
+
+    // Drop the references while no collection may run
+    GCPtr<Payload>::setPolicy(GCPolicy::manual());
+    {
+        std::vector<GCPtr<Payload> > gc(n);
+        for (size_t i = 0; i < n; ++i) gc[i] = make_gc<Payload>((int) i);
+    }
+    start = now();
+    GCPtr<Payload>::collect();
+    report("collect", "gcptr", n, start);
+
+    // A sweep that frees nothing still visits every live entry
+    std::vector<GCPtr<Payload> > live(n);
+    for (size_t i = 0; i < n; ++i) live[i] = make_gc<Payload>((int) i);
+    start = now();
+    GCPtr<Payload>::collect();
+    report("collect_live", "gcptr", n, start);
+    live.clear();
+
+    GCPtr<Payload>::useGlobalPolicy();
+    GCPtr<Payload>::collect();
+}
+
+// Sum an array of n ints, repeated times
+void iterate(size_t n, size_t repeat) {
+
+    long sum = 0;
+    int *raw = new int[n]();
+    std::chrono::steady_clock::time_point start = now();
+    for (size_t r = 0; r < repeat; ++r) {
+        for (int *p = raw; p != raw + n; ++p) sum += *p;
+    }
+    report("iterate", "raw", n * repeat, start);
+    delete[] raw;
+
+    std::shared_ptr<int> shared(new int[n](), std::default_delete<int[]>());
+    start = now();
+    for (size_t r = 0; r < repeat; ++r) {
+        for (int *p = shared.get(); p != shared.get() + n; ++p) sum += *p;
+    }
+    report("iterate", "shared_ptr", n * repeat, start);
+
+    GCPtr<int> gc = make_gc_array<int>((unsigned) n);
+    start = now();
+    for (size_t r = 0; r < repeat; ++r) {
+        for (Iter<int> p = gc.begin(); p != gc.end(); p++) sum += *p;
+    }
+    report("iterate", "gcptr_iter", n * repeat, start);
+
+    sink = sum;
+}
+
+// Allocate n objects, keeping the newest window of them alive
+void churn(size_t n, size_t window) {
+
+    std::vector<Payload *> raws(window, (Payload *) NULL);
+    std::chrono::steady_clock::time_point start = now();
+    for (size_t i = 0; i < n; ++i) {
+        delete raws[i % window];
+        raws[i % window] = new Payload((int) i);
+    }
+    for (size_t i = 0; i < window; ++i) delete raws[i];
+    report("churn", "raw", n, start);
+
+    std::vector<std::shared_ptr<Payload> > shared(window);
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        shared[i % window] = std::make_shared<Payload>((int) i);
+    }
+    shared.clear();
+    report("churn", "shared_ptr", n, start);
+
+    std::vector<GCPtr<Payload> > gc(window);
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        gc[i % window] = make_gc<Payload>((int) i);
+    }
+    gc.clear();
+    GCPtr<Payload>::collect();
+    report("churn", "gcptr", n, start);
+
+    // The same with sweeps batched by the collection policy
+    GCPtr<Payload>::setPolicy(GCPolicy::entries(window));
+    gc.resize(window);
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        gc[i % window] = make_gc<Payload>((int) i);
+    }
+    gc.clear();
+    GCPtr<Payload>::collect();
+    report("churn", "gcptr_batched", n, start);
+    GCPtr<Payload>::useGlobalPolicy();
+}
+
+int main(int argc, char *argv[]) {
+
+    size_t scale = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") json = true;
+        else if (std::atoi(argv[i]) > 0) scale = (size_t) std::atoi(argv[i]);
+    }
+
+    if (!json) std::cout << "benchmark,impl,n,seconds,ns_per_op\n";
+
+    size_t n = 1000000 * scale;
+
+    constructDestroy(n);
+    copy(n);
+    assign(n);
+    for (size_t size = 1000; size <= 100000 * scale; size *= 10) {
+        collectLatency(size);
+    }
+    iterate(100000, 10 * scale);
+    churn(n, 1000);
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <string>
+
+#include "gc.h"
+
+// Checks that one call to collect() or gc::collect_all() frees all the
+// garbage there is, including objects whose last reference is dropped
+// by the destructor of another object freed by the same call. Returns
+// nonzero if any check fails.
+
+const int LENGTH = 1000;
+
+// A node of a singly linked list
+class Link {
+
+public:
+    GCPtr<Link> next;
+};
+
+// A node that can take part in a cycle and holds a list. rest is
+// not reported to the cycle collector, so what it refers to is only
+// freed once a node holding it has been.
+class Ring {
+
+public:
+    GCPtr<Ring> other;
+    GCPtr<Ring> rest;
+    GCPtr<Link> list;
+
+    void gcTrace(GCVisitor &v) {
+        v(other);
+    }
+};
+
+bool failed = false;
+
+void check(const std::string &name, int before, int after) {
+
+    if (after != before) {
+        std::cout << "FAIL " << name << ": " << after - before
+        << " entries left\n";
+        failed = true;
+    } else {
+        std::cout << "ok " << name << "\n";
+    }
+}
+
+// Return a list of n nodes
+GCPtr<Link> chain(int n) {
+
+    GCPtr<Link> head;
+
+    for (int i = 0; i < n; ++i) {
+        GCPtr<Link> l = make_gc<Link>();
+        l->next = head;
+        head = l;
+    }
+    return head;
+}
+
+// Drop a list and free it with one collect()
+void dropChain(const std::string &name, const GCPolicy &policy) {
+
+    GCPtr<Link>::setPolicy(policy);
+    int before = GCPtr<Link>::gclistSize();
+
+    chain(LENGTH);
+    GCPtr<Link>::collect();
+
+    check(name, before, GCPtr<Link>::gclistSize());
+}
+
+int main() {
+
+    dropChain("collect, manual", GCPolicy::manual());
+    dropChain("collect, entry threshold", GCPolicy::entries(100));
+
+    // The same with every type at once
+    GCPtr<Link>::setPolicy(GCPolicy::manual());
+    int before = GCPtr<Link>::gclistSize();
+    chain(LENGTH);
+    gc::collect_all();
+    check("collect_all, manual", before, GCPtr<Link>::gclistSize());
+
+    #ifndef GC_THREAD_SAFE
+    // A garbage cycle whose destructors drop the only reference to a list
+    GCPtr<Ring>::setPolicy(GCPolicy::manual());
+    int rings = GCPtr<Ring>::gclistSize();
+    {
+        GCPtr<Ring> a = make_gc<Ring>(), b = make_gc<Ring>();
+        a->other = b;
+        b->other = a;
+        a->list = chain(LENGTH);
+
+        // A list of rings behind the cycle
+        for (int i = 0; i < LENGTH; ++i) {
+            GCPtr<Ring> r = make_gc<Ring>();
+            r->rest = b->rest;
+            b->rest = r;
+        }
+    }
+    GCPtr<Ring>::collect();
+    GCPtr<Link>::collect();
+    check("cycle holding a list, rings", rings, GCPtr<Ring>::gclistSize());
+    check("cycle holding a list, links", before, GCPtr<Link>::gclistSize());
+    #endif
+
+    GCPtr<Link>::useGlobalPolicy();
+    GCPtr<Ring>::useGlobalPolicy();
+
+    return failed ? 1 : 0;
+}
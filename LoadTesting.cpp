@@ -36,25 +36,24 @@ std::ostream &operator<< (std::ostream &strm, LoadTest &obj) {
 int main() {
 
     GCPtr<LoadTest> mp;
-    int i;
+
+    // Keep some memory back, so that running out costs
+    // a collection rather than an exception
+    GCReserve::set(1024 * 1024);
 
     for (int j = 0; j < 20000; ++j) {
         try {
 
-            mp = new LoadTest(i, i);
+            // make_gc() collects and retries if an allocation fails
+            mp = make_gc<LoadTest>(j, j);
 
-        } catch (bad_alloc xa) {
+        } catch (bad_alloc &xa) {
 
-            // When an allocation error occurs, recycle
-            // garbage by calling collect().
+            // Even the reserve was not enough
             std::cout << "Last object: " << *mp << endl;
-            std::cout << "Length of gclist before calling collect(): "
-            << mp.gclistSize() << endl;
-
-            GCPtr<LoadTest>::collect();
-            std::cout << "Length of gclist after calling collect(): "
-            << mp.gclistSize() << endl;
+            std::cout << "Length of gclist: " << mp.gclistSize() << endl;
+            return 1;
         }
     }
     return 0;
-}
\ No newline at end of file
+}
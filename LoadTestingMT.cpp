@@ -0,0 +1,114 @@
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string>
+
+#define GC_THREAD_SAFE
+#include "gc.h"
+
+// A simple class for load testing GCPtr from several threads
+class LoadTest {
+
+private:
+    int a;
+    int b;
+
+public:
+    double n[100]; // just to take up memory
+    double val;
+
+    LoadTest() {
+        a = b = 0;
+    }
+
+    LoadTest(int x, int y) {
+        a = x;
+        b = y;
+        val = 0.0;
+    }
+
+    friend std::ostream &operator<< (std::ostream &strm, LoadTest &obj);
+};
+
+// Create an inserter for LoadTest
+std::ostream &operator<< (std::ostream &strm, LoadTest &obj) {
+    strm << "(" << obj.a << " " << obj.b << ")";
+    return strm;
+}
+
+// Number of objects each thread allocates
+const int iterations = 200000;
+
+// An object shared by every thread, so its reference count is contended
+GCPtr<LoadTest> shared;
+
+// Allocate, copy and drop GCPtrs. Half of the objects come from
+// make_gc() and half from new, so both registration paths are used.
+void worker(int id) {
+
+    GCPtr<LoadTest> mp;
+
+    for (int j = 0; j < iterations; ++j) {
+
+        if (j % 2) {
+            mp = make_gc<LoadTest>(id, j);
+        } else {
+            mp = new LoadTest(id, j);
+        }
+
+        // Copies of a private and of a shared object
+        GCPtr<LoadTest> copy = mp;
+        GCPtr<LoadTest> s = shared;
+
+        copy->val = s->val + j;
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 4;
+
+    shared = make_gc<LoadTest>(0, 0);
+
+    // Collect in batches so that sweeps run concurrently
+    // with allocation rather than on every release
+    GCPtr<LoadTest>::setPolicy(GCPolicy::entries(1000));
+
+    // With "background" as the argument, sweeps run on the
+    // collector thread instead of the worker threads
+    if (argc > 1 && std::string(argv[1]) == "background") {
+        GCBackground::start();
+    }
+
+    std::cout << "threads,objects,seconds,objects_per_second\n";
+
+    for (unsigned t = 1; t <= maxThreads; t *= 2) {
+
+        std::vector<std::thread> threads;
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+
+        for (unsigned i = 0; i < t; ++i) {
+            threads.push_back(std::thread(worker, i));
+        }
+        for (unsigned i = 0; i < t; ++i) {
+            threads[i].join();
+        }
+
+        std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+        double objects = (double) t * iterations;
+
+        std::cout << t << "," << objects << "," << elapsed.count()
+        << "," << objects / elapsed.count() << endl;
+    }
+
+    GCPtr<LoadTest>::collect();
+    std::cout << "Length of gclist after the last collect(): "
+    << GCPtr<LoadTest>::gclistSize() << endl;
+
+    return 0;
+}
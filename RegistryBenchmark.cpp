@@ -0,0 +1,244 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include "gc.h"
+
+// Measures how the cost of GCPtr operations grows with the number of
+// live entries in gclist, from 10 up to 10^6 (or --max). For each
+// operation the per-operation cost is fitted to n^slope, so a cost
+// that does not depend on n has a slope near 0 and a linear scan of
+// gclist a slope near 1.
+//
+// With --baseline file, each operation is checked against the slope
+// and cost at 1000 entries stored in file, one "operation,slope,ns"
+// line each, and the program fails if either has regressed. Use
+// --write-baseline file to record new figures.
+
+// How much a slope may grow before it counts as a regression
+const double SLOPE_TOLERANCE = 0.25;
+
+// How many times slower than the baseline an operation may be. The
+// baseline may come from a faster machine, so this is generous.
+const double COST_FACTOR = 4.0;
+
+// Operations timed at each size
+const size_t OPS = 20000;
+
+// Timings are repeated and the fastest kept
+const int REPEAT = 3;
+
+class Obj {
+
+public:
+    int val;
+
+    Obj(int v = 0) {
+        val = v;
+    }
+};
+
+volatile long sink;
+
+std::chrono::steady_clock::time_point now() {
+    return std::chrono::steady_clock::now();
+}
+
+double nsSince(std::chrono::steady_clock::time_point start, size_t ops) {
+    std::chrono::duration<double> elapsed = now() - start;
+    return elapsed.count() * 1e9 / ops;
+}
+
+// The results of one size
+struct Sample {
+    double construct, copy, lookup, destruct, collect;
+};
+
+// Time each operation with n entries live
+Sample measure(size_t n) {
+
+    Sample best = { 1e30, 1e30, 1e30, 1e30, 1e30 };
+
+    GCPtr<Obj>::setPolicy(GCPolicy::manual());
+
+    std::vector<GCPtr<Obj> > live(n);
+    std::vector<Obj *> raw(n);
+    for (size_t i = 0; i < n; ++i) {
+        raw[i] = new Obj((int) i);
+        live[i] = raw[i];
+    }
+
+    for (int r = 0; r < REPEAT; ++r) {
+
+        std::vector<GCPtr<Obj> > made(OPS);
+        std::chrono::steady_clock::time_point start;
+        double ns;
+
+        // Register new objects
+        start = now();
+        for (size_t i = 0; i < OPS; ++i) made[i] = new Obj((int) i);
+        ns = nsSince(start, OPS);
+        if (ns < best.construct) best.construct = ns;
+
+        // Copy a live GCPtr
+        start = now();
+        for (size_t i = 0; i < OPS; ++i) {
+            GCPtr<Obj> c = live[i % n];
+            sink = c->val;
+        }
+        ns = nsSince(start, OPS);
+        if (ns < best.copy) best.copy = ns;
+
+        // Find the entries of live objects from their addresses
+        size_t k = 12345;
+        start = now();
+        for (size_t i = 0; i < OPS; ++i) {
+            k = k * 1103515245 + 12345;
+            GCPtr<Obj> c = raw[(k >> 8) % n];
+            sink = c->val;
+        }
+        ns = nsSince(start, OPS);
+        if (ns < best.lookup) best.lookup = ns;
+
+        // Drop the only references to the new objects
+        start = now();
+        made.clear();
+        ns = nsSince(start, OPS);
+        if (ns < best.destruct) best.destruct = ns;
+
+        // Free them, visiting every live entry on the way
+        start = now();
+        GCPtr<Obj>::collect();
+        ns = nsSince(start, n + OPS);
+        if (ns < best.collect) best.collect = ns;
+    }
+
+    live.clear();
+    GCPtr<Obj>::collect();
+    GCPtr<Obj>::useGlobalPolicy();
+
+    return best;
+}
+
+// Fit log(ns) = slope * log(n) + c by least squares and return slope
+double slopeOf(const std::vector<size_t> &sizes, const std::vector<double> &ns) {
+
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    size_t m = sizes.size();
+
+    for (size_t i = 0; i < m; ++i) {
+        double x = std::log((double) sizes[i]);
+        double y = std::log(ns[i]);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    return (m * sxy - sx * sy) / (m * sxx - sx * sx);
+}
+
+int main(int argc, char *argv[]) {
+
+    size_t maxSize = 1000000;
+    std::string baseline, writeBaseline;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max" && i + 1 < argc) maxSize = std::strtoul(argv[++i], NULL, 10);
+        else if (arg == "--baseline" && i + 1 < argc) baseline = argv[++i];
+        else if (arg == "--write-baseline" && i + 1 < argc) writeBaseline = argv[++i];
+    }
+
+    const char *names[] = { "construct", "copy", "lookup", "destruct", "collect" };
+    const int OPERATIONS = 5;
+
+    std::vector<size_t> sizes;
+    std::vector<double> results[OPERATIONS];
+    double at1000[OPERATIONS];
+
+    std::cout << "operation,n,ns_per_op\n";
+
+    for (size_t n = 10; n <= maxSize; n *= 10) {
+
+        Sample s = measure(n);
+        double values[] = { s.construct, s.copy, s.lookup, s.destruct, s.collect };
+
+        sizes.push_back(n);
+        for (int o = 0; o < OPERATIONS; ++o) {
+            results[o].push_back(values[o]);
+            if (n == 1000) at1000[o] = values[o];
+            std::cout << names[o] << "," << n << "," << values[o] << "\n";
+        }
+    }
+
+    if (sizes.size() < 3 || maxSize < 1000) {
+        std::cout << "Need sizes up to at least 1000 to fit a curve\n";
+        return 1;
+    }
+
+    double slopes[OPERATIONS];
+
+    std::cout << "\noperation,slope,ns_at_1000\n";
+    for (int o = 0; o < OPERATIONS; ++o) {
+        slopes[o] = slopeOf(sizes, results[o]);
+        std::cout << names[o] << "," << slopes[o] << "," << at1000[o] << "\n";
+    }
+
+    if (!writeBaseline.empty()) {
+        std::ofstream out(writeBaseline.c_str());
+        for (int o = 0; o < OPERATIONS; ++o) {
+            out << names[o] << "," << slopes[o] << "," << at1000[o] << "\n";
+        }
+    }
+
+    if (baseline.empty()) return 0;
+
+    // Read the baseline
+    std::ifstream in(baseline.c_str());
+    if (!in) {
+        std::cout << "Cannot read baseline " << baseline << "\n";
+        return 1;
+    }
+
+    std::map<std::string, std::pair<double, double> > expected;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string name, slope, ns;
+        std::getline(fields, name, ',');
+        std::getline(fields, slope, ',');
+        std::getline(fields, ns, ',');
+        expected[name] = std::make_pair(std::atof(slope.c_str()), std::atof(ns.c_str()));
+    }
+
+    bool failed = false;
+
+    std::cout << "\n";
+    for (int o = 0; o < OPERATIONS; ++o) {
+
+        if (!expected.count(names[o])) continue;
+        std::pair<double, double> e = expected[names[o]];
+
+        if (slopes[o] > e.first + SLOPE_TOLERANCE) {
+            std::cout << "FAIL " << names[o] << ": slope " << slopes[o]
+            << " exceeds baseline " << e.first << "\n";
+            failed = true;
+        }
+        if (at1000[o] > e.second * COST_FACTOR) {
+            std::cout << "FAIL " << names[o] << ": " << at1000[o]
+            << " ns per operation exceeds baseline " << e.second << "\n";
+            failed = true;
+        }
+    }
+
+    if (!failed) std::cout << "All operations within the baseline\n";
+    return failed ? 1 : 0;
+}
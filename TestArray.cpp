@@ -1,13 +1,16 @@
 #include <iostream>
 #include <new>
+
+#define DISPLAY
 #include "gc.h"
 
 int main() {
 
     try {
 
-        // Create a GCPtr to an allocated array of 10 ints
-        GCPtr<int> ap = new int[10];
+        // Create a GCPtr to an allocated array of 10 ints. Giving
+        // the length makes the array be freed with delete[].
+        GCPtr<int> ap(new int[10], 10);
 
         // Give the array some values using an array indexing
         for (int i = 0; i < 10; ++i) {
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <new>
+
+#define DISPLAY
 #include "gc.h"
 
 
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <new>
+
+#define DISPLAY
 #include "gc.h"
 
 
@@ -115,11 +117,14 @@ int main() {
             ip = new int(k+10);
         }
 
-        // Now manually garbage collect GCPTtr<int> list
-        // Keep in mind that GCPtr<int, 5> pointers will not be collected
-        // by this call
+        // Now manually garbage collect GCPTtr<int> list. GCPtr<int, 5>
+        // shares this list, so its arrays are collected here as well
         GCPtr<int>::collect();
 
+        // gc::collect_all() collects every type of GCPtr at once
+        std::cout << "Objects freed by collect_all(): "
+        << gc::collect_all() << endl;
+
         // Now use GCPtr with class type
         GCPtr<MyClass> ob = new MyClass(10, 20);
 
@@ -137,6 +142,11 @@ int main() {
         ob->val = 19.21;
         std::cout << "ob->val : " << ob->val << "\n\n";
 
+        // make_gc() allocates the object and its gclist
+        // entry together in a single block
+        GCPtr<MyClass> ob2 = make_gc<MyClass>(12, 22);
+        std::cout << "ob2 points to " << *ob2 << "\n\n";
+
         std::cout << "Now work with pointers to class objects.\n";
 
         // Declare a GCPtr to a 5 elements array
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <new>
+
+#define DISPLAY
+#include "gc.h"
+
+// A node in a doubly linked list. Each node refers to its
+// neighbours through GCPtrs, so neighbouring nodes form cycles
+// that reference counting alone can never free.
+class Node {
+
+public:
+    int val;
+    GCPtr<Node> next;
+    GCPtr<Node> prev;
+
+    Node(int v = 0) {
+        val = v;
+    }
+
+    ~Node() {
+        std::cout << "Destructing Node " << val << "\n";
+    }
+
+    // Report the GCPtrs inside this object to the cycle collector
+    void gcTrace(GCVisitor &v) {
+        v(next);
+        v(prev);
+    }
+
+    friend std::ostream &operator<<(std::ostream &strm, Node &obj);
+};
+
+// An overloaded inserter to display Node
+std::ostream &operator<<(std::ostream &strm, Node &obj) {
+    strm << "Node " << obj.val;
+    return strm;
+}
+
+int main() {
+
+    try {
+
+        // Build a list of three nodes and then drop it
+        {
+            GCPtr<Node> a = make_gc<Node>(1);
+            GCPtr<Node> b = make_gc<Node>(2);
+            GCPtr<Node> c = make_gc<Node>(3);
+
+            a->next = b;
+            b->prev = a;
+            b->next = c;
+            c->prev = b;
+        }
+
+        // Every node is still referenced by its neighbours
+        std::cout << "Length of gclist before calling collect(): "
+        << GCPtr<Node>::gclistSize() << endl;
+
+        GCPtr<Node>::collect();
+
+        std::cout << "Objects freed in cycles: "
+        << GCCycleCollector::lastFreed() << endl;
+        std::cout << "Length of gclist after calling collect(): "
+        << GCPtr<Node>::gclistSize() << endl;
+
+    } catch (bad_alloc &exc) {
+        std::cout << "Allocation error!\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <new>
+
+#include "gc_parallel.h"
+
+int main() {
+
+    try {
+
+        const unsigned n = 100000;
+
+        GCPtr<double> a = make_gc_array<double>(n);
+        GCPtr<double> b = make_gc_array<double>(n);
+
+        // Fill the array with 0, 1, 2, ...
+        unsigned i = 0;
+        for (Iter<double> p = a.begin(); p != a.end(); ++p) *p = i++;
+
+        // Square every element in place
+        gc::parallel_for_each(a, [](double &x) { x = x * x; });
+
+        // Halve every element into b
+        gc::parallel_transform(a, b, [](double x) { return x / 2; });
+
+        double sum = gc::parallel_reduce(b, 0.0, [](double x, double y) { return x + y; });
+
+        std::cout << "Worker threads: " << GCThreadPool::instance().workers() << endl;
+        std::cout << "b[10] is " << b[10] << endl;
+        std::cout << "Sum of b is " << sum << endl;
+
+        // The output array must be at least as long as the input
+        GCPtr<double> shorter = make_gc_array<double>(n / 2);
+        try {
+            gc::parallel_transform(a, shorter, [](double x) { return x; });
+        } catch (OutOfRangeExc &exc) {
+            std::cout << "Output array too short\n";
+        }
+
+    } catch (bad_alloc &exc) {
+        std::cout << "Allocation error!\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <new>
+
+#define GC_TRACING
+#define DISPLAY
+#include "gc.h"
+
+// A node in a doubly linked list. Under tracing the collector
+// finds the GCPtrs inside a node through gcTrace().
+class Node {
+
+public:
+    int val;
+    GCPtr<Node> next;
+    GCPtr<Node> prev;
+
+    Node(int v = 0) {
+        val = v;
+    }
+
+    ~Node() {
+        std::cout << "Destructing Node " << val << "\n";
+    }
+
+    // Report the GCPtrs inside this object to the collector
+    void gcTrace(GCVisitor &v) {
+        v(next);
+        v(prev);
+    }
+
+    friend std::ostream &operator<<(std::ostream &strm, Node &obj);
+};
+
+// An overloaded inserter to display Node
+std::ostream &operator<<(std::ostream &strm, Node &obj) {
+    strm << "Node " << obj.val;
+    return strm;
+}
+
+int main() {
+
+    try {
+
+        // Collect only when asked to
+        GCPtr<Node>::setPolicy(GCPolicy::manual());
+
+        // head is a root, so the list is reachable while it is in scope
+        GCRoot<Node> head = make_gc<Node>(1);
+
+        {
+            GCRoot<Node> tail = make_gc<Node>(3);
+
+            head->next = make_gc<Node>(2);
+            head->next->prev = head;
+            head->next->next = tail;
+            tail->prev = head->next;
+        }
+
+        GCPtr<Node>::collect();
+        std::cout << "Length of gclist while the list is reachable: "
+        << GCPtr<Node>::gclistSize() << endl;
+
+        // Drop the last two nodes. They still refer to each other.
+        head->next = NULL;
+
+        GCPtr<Node>::collect();
+        std::cout << "Objects freed: "
+        << GCMarkSweep::lastFreed() << endl;
+        std::cout << "Length of gclist after calling collect(): "
+        << GCPtr<Node>::gclistSize() << endl;
+
+    } catch (bad_alloc &exc) {
+        std::cout << "Allocation error!\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <new>
+
+#define DISPLAY
+#include "gc.h"
+
+// A class whose objects are observed through GCWeakPtrs
+class Widget {
+
+public:
+    int id;
+
+    Widget(int i = 0) {
+        id = i;
+    }
+
+    ~Widget() {
+        std::cout << "Destructing Widget " << id << "\n";
+    }
+
+    friend std::ostream &operator<<(std::ostream &strm, Widget &obj);
+};
+
+// An overloaded inserter to display Widget
+std::ostream &operator<<(std::ostream &strm, Widget &obj) {
+    strm << "Widget " << obj.id;
+    return strm;
+}
+
+// Report whether the object w refers to still exists
+void show(GCWeakPtr<Widget> &w) {
+
+    // lock() returns a null GCPtr once the widget is freed
+    GCPtr<Widget> p = w.lock();
+
+    if (p) {
+        std::cout << "Observed: " << *p << endl;
+    } else {
+        std::cout << "Observed widget is gone\n";
+    }
+}
+
+int main() {
+
+    try {
+
+        GCWeakPtr<Widget> observer;
+
+        {
+            GCPtr<Widget> w = make_gc<Widget>(1);
+
+            // The weak pointer does not keep the widget alive
+            observer = w;
+            show(observer);
+        }
+
+        // Nothing but the weak pointer refers to the widget now
+        GCPtr<Widget>::collect();
+
+        show(observer);
+
+    } catch (bad_alloc &exc) {
+        std::cout << "Allocation error!\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,19 +1,82 @@
 /*
- * A single-threaded garbage collector
+ * A reference counting garbage collector. It is single-threaded
+ * unless GC_THREAD_SAFE is defined before this header is included.
+ * Defining GC_TRACING instead selects a mark-sweep collector.
  */
 
 #ifndef GARBAGECOLLECTOR_GC_H
 #define GARBAGECOLLECTOR_GC_H
 
 #include <iostream>
-#include <list>
+#include <new>
+#include <utility>
 #include <typeinfo>
 #include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include <type_traits>
+
+#include <chrono>
+
+#if defined(GC_THREAD_SAFE) || defined(GC_TRACE_EVENTS)
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#endif
 
 using namespace std;
 
-// To watch the action of the garbage collector, define DISPLAY.
-#define DISPLAY
+// To watch the action of the garbage collector, define DISPLAY before
+// including this header. Every GCPtr operation then writes to cout, and
+// T must have an inserter, so it is only fit for small demonstrations.
+// Output from several threads would interleave, so it cannot be used
+// in thread-safe mode. Define GC_TRACE_EVENTS to record the same events
+// cheaply, for reading later.
+#if defined(DISPLAY) && defined(GC_THREAD_SAFE)
+#error "DISPLAY cannot be combined with GC_THREAD_SAFE"
+#endif
+
+// Define GC_THREAD_SAFE to share GCPtrs between threads. Reference
+// counts and collector bookkeeping become atomic, and each gclist is
+// guarded by a mutex that is held only while entries are added,
+// looked up or unlinked. Objects are destroyed outside the lock.
+// GCBackground can then move sweeping onto a collector thread.
+// Define GC_TRACING to replace reference counting with mark-sweep
+// collection. Copying, assigning and destroying a GCPtr then never
+// touches collector state. A collection marks every object reachable
+// from a live GCRoot, following the GCPtrs each object reports through
+// gcTrace(), and frees the rest. GCPtrs on the stack or in globals must
+// be GCRoots, every class whose objects hold GCPtrs must declare
+// gcTrace(), and such objects should be created with make_gc(), which
+// holds off collection while they are being constructed.
+#if defined(GC_TRACING) && defined(GC_THREAD_SAFE)
+#error "GC_TRACING cannot be combined with GC_THREAD_SAFE"
+#endif
+
+#ifdef GC_THREAD_SAFE
+typedef atomic<unsigned> GCCount; // type of a reference count
+typedef atomic<size_t> GCCounter; // type of collector bookkeeping
+typedef atomic<unsigned char> GCAge; // type of an entry's age
+typedef atomic<size_t> GCStat; // type of a statistics counter
+typedef atomic<bool> GCFlag; // type of a flag read without a lock
+typedef mutex GCMutex; // lock guarding a gclist
+#else
+typedef unsigned GCCount;
+typedef size_t GCCounter;
+typedef unsigned char GCAge;
+typedef size_t GCStat;
+typedef bool GCFlag;
+
+// A lock that does nothing, used when there is only one thread
+class GCMutex {
+public:
+    void lock() {}
+    void unlock() {}
+};
+#endif
 
 // Exception thrown when an attempt is made to use an Iter that
 // exceeds the range if the underlying object
@@ -21,23 +84,58 @@ class OutOfRangeExc {
     // Add functionality if needed by your application
 };
 
+// Bounds checking policies for Iter. An Iter throws OutOfRangeExc on
+// an access outside its array only if its policy is enabled.
+struct GCBoundsChecked {
+    static const bool enabled = true;
+};
+
+// Checked unless NDEBUG is defined
+struct GCBoundsDebug {
+#ifdef NDEBUG
+    static const bool enabled = false;
+#else
+    static const bool enabled = true;
+#endif
+};
+
+// Never checked. Loops through such an Iter compile
+// to the same code as loops through a pointer.
+struct GCBoundsUnchecked {
+    static const bool enabled = false;
+};
+
 // An iterator-like class for cycling through arrays
 // that are pointed to by GCPtrs. Iter pointers
 // ** do not ** participate in or affect garbage collection.
 // Thus, an Iter pointing to some object does not prevent that
 // object from being recycled
 //
-template <class T> class Iter {
+template <class T, class Bounds = GCBoundsChecked> class Iter {
 
     T *ptr; // current pointer value
     T *end; // points to element one past end
     T *begin; // points to start of allocated array
-    unsigned length; // length of sequence
+
+    // Throw OutOfRangeExc if p is outside the array and Bounds checks
+    void check(T *p) const {
+        if (Bounds::enabled && ((p >= end) || (p < begin))) {
+            throw OutOfRangeExc();
+        }
+    }
+
+    template <class U, class B> friend class Iter;
 
 public:
+    // Iter is a random access iterator over contiguous memory
+    typedef random_access_iterator_tag iterator_category;
+    typedef typename remove_const<T>::type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef T *pointer;
+    typedef T &reference;
+
     Iter() {
         ptr = end = begin = NULL;
-        length = 0;
     }
 
     Iter(T *p, T *first, T *last) {
@@ -45,123 +143,197 @@ public:
         ptr = p;
         end = last;
         begin = first;
-        length = last - first;
+    }
+
+    // An Iter can be converted to one over const objects
+    template <class U>
+    Iter(const Iter<U, Bounds> &it,
+         typename enable_if<is_convertible<U *, T *>::value>::type * = NULL) {
+
+        ptr = it.ptr;
+        end = it.end;
+        begin = it.begin;
     }
 
     // Return length of sequence to which this Iter points
-    unsigned size() { return length; }
+    unsigned size() const { return end - begin; }
 
     // Return value pointed to by ptr
     // Do not allow out of bounds access
-    T &operator* () {
-        if ( (ptr >= end) || (ptr < begin)) {
-            throw OutOfRangeExc();
-        }
+    T &operator* () const {
+        check(ptr);
         return *ptr;
     }
 
     // Return address contained in ptr
     // Do not allow out-of-bounds access
-    T *operator->() {
-        if ((ptr >= end) || (ptr < begin)) {
-            throw OutOfRangeExc();
-        }
+    T *operator->() const {
+        check(ptr);
         return ptr;
     }
 
     // Prefix ++
-    Iter operator++() {
+    Iter &operator++() {
         ptr++;
         return *this;
     }
 
     // Prefix --
-    Iter operator--() {
+    Iter &operator--() {
         ptr--;
         return *this;
     }
 
     // Postfix ++
-    Iter operator++(int notUsed) {
+    Iter operator++(int) {
 
-        T *tmp = ptr;
+        Iter tmp = *this;
 
         ptr++;
-        return Iter<T>(tmp, begin, end);
+        return tmp;
     }
 
     // Postfix --
-    Iter operator--(int notUsed) {
+    Iter operator--(int) {
 
-        T *tmp = ptr;
+        Iter tmp = *this;
 
         ptr--;
-        return Iter<T>(tmp, begin, end);
+        return tmp;
     }
 
-    // Return a reference to the object at the specified index
+    // Return a reference to the object i places from ptr
     // Do not allow out-of-bounds access
-    T &operator [] (int i) {
-        if ( (i < 0) || (i >= (end - begin))) {
-            throw OutOfRangeExc();
-        }
+    T &operator [] (difference_type i) const {
+        check(ptr + i);
         return ptr[i];
     }
 
     // Define relational operators.
-    bool operator == (Iter op2) {
+    bool operator == (const Iter &op2) const {
         return ptr == op2.ptr;
     }
 
-    bool operator != (Iter op2) {
+    bool operator != (const Iter &op2) const {
         return ptr != op2.ptr;
     }
 
-    bool operator < (Iter op2) {
+    bool operator < (const Iter &op2) const {
         return ptr < op2.ptr;
     }
 
-    bool operator <= (Iter op2) {
+    bool operator <= (const Iter &op2) const {
         return ptr <= op2.ptr;
     }
 
-    bool operator > (Iter op2) {
+    bool operator > (const Iter &op2) const {
         return ptr > op2.ptr;
     }
 
-    bool operator >= (Iter op2) {
+    bool operator >= (const Iter &op2) const {
         return ptr >= op2.ptr;
     }
 
-    // Subtract an integer from an Iter
-    Iter operator - (int n) {
+    // Move an Iter by n places
+    Iter &operator += (difference_type n) {
 
-        ptr -= n;
+        ptr += n;
         return *this;
     }
 
-    // Add an integer to Iter
-    Iter operator + (int n) {
+    Iter &operator -= (difference_type n) {
 
-        ptr += n;
+        ptr -= n;
         return *this;
     }
 
+    // Return an Iter n places before this one
+    Iter operator - (difference_type n) const {
+        return Iter(ptr - n, begin, end);
+    }
+
+    // Return an Iter n places after this one
+    Iter operator + (difference_type n) const {
+        return Iter(ptr + n, begin, end);
+    }
+
+    friend Iter operator + (difference_type n, const Iter &it) {
+        return it + n;
+    }
+
     // Return number of elements between 2 Iters
-    int operator - (Iter<T> &itr2) {
+    difference_type operator - (const Iter &itr2) const {
         return ptr - itr2.ptr;
     }
 };
 
-// This class defines an element that is stored in the
-// garbage collection information list
-template <class T> class GCInfo {
+// A range of objects in an array pointed to by a GCPtr whose bounds
+// were checked once, when it was made by GCPtr::span(). It is walked
+// with plain pointers. Like an Iter, it does not keep the objects alive.
+template <class T> class GCSpan {
+    T *first; // the first object
+    T *last; // one past the last object
 
 public:
+    GCSpan(T *f, T *l) {
+        first = f;
+        last = l;
+    }
 
-    unsigned refcount; // current reference count
+    T *begin() const { return first; }
+    T *end() const { return last; }
+    T *data() const { return first; }
 
-    T *memPtr; // Pointer to the allocated memory
+    unsigned size() const { return last - first; }
+
+    T &operator[](unsigned i) const {
+        return first[i];
+    }
+};
+
+template <class T, int size = 0> class GCPtr;
+class GCInfoBase;
+class GCVisitor;
+
+// The operations the collector needs on an entry whose type it does
+// not know. Each GCPtr type has one table, shared by all its entries.
+struct GCInfoOps {
+    void (*trace)(GCInfoBase *p, GCVisitor &v); // visit the GCPtrs inside the object
+    void (*unlink)(GCInfoBase *p); // remove the entry from its gclist
+    void (*destroyObject)(GCInfoBase *p); // destroy the managed object
+    void (*freeEntry)(GCInfoBase *p); // release the entry itself
+    void (*show)(GCInfoBase *p); // report the object about to be deleted
+};
+
+// This class holds the part of a garbage collection information list
+// element that does not depend on the type of the managed object, so
+// the cycle collector can follow references between types.
+class GCInfoBase {
+
+public:
+
+    // Colours used by the cycle collector
+    enum Color { BLACK, GRAY, WHITE, PURPLE };
+
+    // rootIndex of an entry that is not a candidate root
+    static const unsigned NOT_BUFFERED = ~0u;
+
+    // Tracing collections an entry survives before it is promoted to
+    // the old generation. Reference counting promotes by GCHeap::youngLimit().
+    static const unsigned char TENURE = 2;
+
+    GCCount refcount; // current reference count
+
+    // GCWeakPtrs that refer to this entry. While there are any, the
+    // entry outlives its object, which is destroyed as usual.
+    GCCount weakcount;
+
+    // Changed when the entry is removed from its gclist, so a
+    // GCWeakPtr can tell in O(1) that its object is gone
+    GCCount generation;
+
+    // True once the object is destroyed and only GCWeakPtrs hold the entry
+    bool orphaned;
 
     /* isArray is true if memPtr points to an allocated array.
      * It is false otherwise. */
@@ -171,376 +343,3660 @@ public:
      * then arraySize contains its size */
     unsigned arraySize; // size of array
 
-    // Here, mPtr points to the allocated memory.
-    // Of this is an array, then size specifies
-    // the size of the array
-    GCInfo(T *mPtr, unsigned size = 0) {
+    /* coLocated is true if this entry and the memory it manages were
+     * allocated as one block by make_gc() or make_gc_array(). */
+    bool coLocated;
+
+    // The following are used only by the cycle collector
+    unsigned char color; // one of Color
+    unsigned rootIndex; // position in the candidate root buffer
+    unsigned crc; // reference count left during trial deletion
+
+    // In tracing mode, true once a collection has found this entry reachable
+    bool marked;
+
+    // Collections survived in tracing mode, up to TENURE. Young entries
+    // stay at the front of gclist, so a minor collection only scans them.
+    GCAge age;
+
+    // In tracing mode, true while this young entry is in the
+    // remembered set kept by the write barrier
+    bool remembered;
+
+    // Operations for the type of this entry, set when it joins a gclist
+    const GCInfoOps *ops;
+
+    // If this is an array, then size specifies the size of the array
+    GCInfoBase(unsigned size) {
         refcount = 1;
-        memPtr = mPtr;
+        weakcount = 0;
+        generation = 0;
+        orphaned = false;
         isArray = size != 0;
         arraySize = size;
+        coLocated = false;
+        color = BLACK;
+        rootIndex = NOT_BUFFERED;
+        crc = 0;
+        marked = false;
+        age = 0;
+        remembered = false;
+        ops = NULL;
     }
-};
 
-// Overloading operator== allows GCInfos to be compared
-// This is needed by the STL list class
-template <class T> bool operator== (const GCInfo<T> &ob1, const GCInfo<T> &ob2) {
-    return (ob1.memPtr == ob2.memPtr);
-}
-
-// GCInfo implements a pointer type that uses garbage collection to release unused memory.
-// A GCPtr must only be used to point to memory that was dynamically allocated using new.
-// When used to refer to an allocated array, specify the array size.
-template <class T, int size = 0> class GCPtr {
+    // Return true if this entry belongs to the old generation
+    bool isOld() const {
+        return age >= TENURE;
+    }
+};
 
-        // gclist maintains the garbage collection list.
-        static list<GCInfo<T>> gclist;
+// A GCVisitor is passed to gcTrace(). Objects that can take part in
+// reference cycles must belong to a class that declares
+//     void gcTrace(GCVisitor &v);
+// which calls v(p) for each GCPtr member p. Objects of other
+// classes are treated as leaves by the cycle collector.
+class GCVisitor {
 
-        // addr points to the allocated memory to which this GCPtr pointer currently points
-        T *addr;
+public:
+    virtual ~GCVisitor() {}
 
-        /* isArray is true if this GCPtr points to an allocated array.
-         * It is false otherwise */
-        bool isArray; // true if pointing to an array
+    template <class U, int s> void operator()(const GCPtr<U, s> &p) {
+        if (p.info && p.info->memPtr) visit(p.info);
+    }
 
-        // If this GCPtr is pointing to an allocated array, then arraySize contains its size.
-        unsigned arraySize; // the size of the array
+protected:
+    // Called once for each non-null GCPtr reported by gcTrace()
+    virtual void visit(GCInfoBase *p) = 0;
+};
 
-        static bool first; // true when first GCPtr is created
+// GCTraceable<T>::value is true if T declares gcTrace()
+template <class T> class GCTraceable {
 
-        // Return an iterator to pointer info in gclist
-        typename list<GCInfo<T>>::iterator findPtrInfo(T *ptr);
+    template <class U> static char test(decltype(&U::gcTrace));
+    template <class U> static long test(...);
 
 public:
-    // Define an iterator type for GCPtr<T>
-    typedef Iter<T> GCIterator;
+    static const bool value = sizeof(test<T>(0)) == 1;
+};
 
-    // Construct both initialized and uninitialized objects
-    GCPtr(T *t=NULL) {
+// GCIndex is an address-keyed hash table used to locate the
+// gclist entry for a given pointer without scanning the list.
+// It uses open addressing with linear probing. Removal shifts
+// following entries back so that no tombstones are needed.
+template <class K, class V> class GCIndex {
 
-        // Register shutdown() as an exit function.
-        if (first) std::atexit(shutdown);
-        first = false;
+    struct Slot {
+        K key;
+        V value;
+        bool used;
+    };
 
-        typename list<GCInfo<T>>::iterator p;
+    Slot *slots; // the table itself
+    size_t capacity; // number of slots, always a power of two
+    size_t count; // number of used slots
 
-        p = findPtrInfo(t);
+    // Return the preferred slot for key
+    size_t home(K key) const {
+        uintptr_t h = (uintptr_t) key;
 
-        // if t is already in gclist, then increment its reference count.
-        // Otherwise, add it to the list
-        if (p != gclist.end()) {
-            p->refcount++; // increment ref count
-        } else {
-            // Create and store this entry
-            GCInfo<T> gcObj(t, size);
-            gclist.push_front(gcObj);
-        }
+        // Allocated addresses are aligned, so drop the low bits
+        // and spread the rest with a multiplicative hash
+        h = (h >> 4) * (uintptr_t) 0x9E3779B97F4A7C15ULL;
+        return (size_t) (h >> (sizeof(uintptr_t) * 4)) & (capacity - 1);
+    }
 
-        addr = t;
-        arraySize = size;
-        isArray = size > 0;
+    // Double the size of the table and rehash every entry
+    void grow() {
+        Slot *old = slots;
+        size_t oldCapacity = capacity;
 
-        #ifdef DISPLAY
-        cout << "Constructing GCPtr. ";
-        if (isArray) {
-            cout << "size is : " << arraySize << endl;
-        } else {
-            cout << endl;
+        capacity = capacity ? capacity * 2 : 16;
+        slots = new Slot[capacity]();
+        count = 0;
+
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (old[i].used) insert(old[i].key, old[i].value);
         }
+        delete[] old;
+    }
 
-        #endif
+public:
+    // The table is constant-initialized and frees its slots whenever it
+    // becomes empty instead of in a destructor. A static GCIndex is then
+    // usable by GCPtrs constructed or destroyed during static
+    // initialization and destruction, in any order.
+    constexpr GCIndex() : slots(NULL), capacity(0), count(0) {}
+
+    // Return a pointer to the value stored for key, or NULL if key is absent
+    V *find(K key) {
+        if (!count) return NULL;
+
+        for (size_t i = home(key); slots[i].used; i = (i + 1) & (capacity - 1)) {
+            if (slots[i].key == key) return &slots[i].value;
+        }
+        return NULL;
     }
 
-    // Copy constructor
-    GCPtr(const GCPtr &ob) {
+    // Add key to the table. key must not already be present
+    void insert(K key, V value) {
 
-        typename list<GCInfo<T>>::iterator p;
+        // Keep the load factor under 70% so probe sequences stay short
+        if ((count + 1) * 10 > capacity * 7) grow();
 
-        p = findPtrInfo(ob.addr);
-        p->refcount++; // increment ref count
+        size_t i = home(key);
+        while (slots[i].used) i = (i + 1) & (capacity - 1);
 
-        addr = ob.addr;
-        arraySize = ob.arraySize;
-        isArray = arraySize > 0;
-        #ifdef DISPLAY
-            cout << "Constructing copy";
-            if (isArray) {
-                cout << "Size is " << arraySize << endl;
-            } else {
-                cout << endl;
-            }
-        #endif
+        slots[i].key = key;
+        slots[i].value = value;
+        slots[i].used = true;
+        count++;
     }
 
-    // Destructor for GCPtr
-    ~GCPtr();
+    // Remove key from the table if present
+    void erase(K key) {
+        if (!count) return;
 
-    // Collect garbage. Returns true if at least one object was freed
-    static bool collect();
+        size_t mask = capacity - 1;
+        size_t i = home(key);
 
-    // overload assignment of pointer to GCPtr
-    T *operator=(T *t);
+        while (slots[i].used && slots[i].key != key) i = (i + 1) & mask;
+        if (!slots[i].used) return;
 
-    // Overload asssignment of GCPtr to GCPtr
-    GCPtr &operator=(GCPtr &rv);
+        // Shift back any entry whose probe sequence passes through i
+        for (size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+            size_t k = home(slots[j].key);
 
-    // Return reference to the object pointed to by this GCPtr
-    T &operator*() {
-        return *addr;
-    }
+            if (((j - k) & mask) >= ((j - i) & mask)) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i].used = false;
 
-    // Return address being pointer to
-    T *operator->() {
-        return addr;
+        if (--count == 0) {
+            delete[] slots;
+            slots = NULL;
+            capacity = 0;
+        }
     }
 
-    // Return a reference to the object at the index specified by i
-    T &operator[](int i) {
-        return addr[i];
-    }
+    // Return the number of entries in the table
+    size_t size() const { return count; }
 
-    // Conversion to T *
-    operator T *() {
-        return addr;
+private:
+    // The table owns its slots, so do not allow copies
+    GCIndex(const GCIndex &);
+    GCIndex &operator=(const GCIndex &);
+};
+
+// GCSingleton<S>::get() returns the one S, made on first use. It is
+// never destroyed: GCPtrs and blocks held by static objects may be
+// released after static destruction has begun, and the state of the
+// pool, the collectors and the statistics must still be there then.
+template <class S> class GCSingleton {
+public:
+    static S &get() {
+        static S *s = new S;
+        return *s;
     }
+};
+
+// GCPool provides the blocks made by make_gc() and make_gc_array().
+// A small block is rounded up to one of a few size classes. Each class
+// keeps a free list, so a block is allocated or freed in a few
+// instructions and a freed block is reused by the next allocation of
+// the same class. When a class has no free block, a new one is taken by
+// bump pointer from the slab the class is filling, so young objects are
+// laid out together in allocation order. Larger blocks come from
+// operator new. Slabs are never returned to the system.
+//
+// Every slab holds blocks of one class and is aligned to its size,
+// which lets the write barrier find the block holding any address.
+//
+// Define GC_NO_POOL to take every block from operator new, which lets
+// memory checkers see each block on its own.
+class GCPool {
 
-    // Return an Iter to the start of the allocated memory
-    Iter<T> begin() {
+public:
 
-        int sz;
+    // Blocks of up to this many bytes come from a size class
+    static const size_t MAX_SMALL = 4096;
 
-        if (isArray) sz = arraySize;
-        else sz=1;
+    // Bytes in a slab
+    static const size_t SLAB_SIZE = 64 * 1024;
 
-        return Iter<T>(addr, addr, addr + sz);
-    }
+    // Slabs taken from the system at a time
+    static const size_t ARENA_SLABS = 16;
 
-    // Return an Iter to one past the end of an allocated array
-    Iter<T> end() {
+    // Return a block of at least n bytes
+    static void *allocate(size_t n) {
 
-        int sz;
+        #ifndef GC_NO_POOL
+        if (n <= MAX_SMALL) {
 
-        if (isArray) sz = arraySize;
-        else sz = 1;
+            State &s = state();
+            Class &c = s.classes[s.classOf[index(n)]];
+            lock_guard<GCMutex> guard(c.mutex);
 
-        return Iter<T>(addr + sz, addr, addr + sz);
-    }
+            Block *b = c.free;
+            if (b) {
+                c.free = b->next;
+                return b;
+            }
 
-    // Return the size of gclist for this type of GCPtr
-    static int gclistSize() {
-        return gclist.size();
+            // Bump allocate, starting a new slab if this one is full
+            if (c.bump + c.size > c.end) newSlab(c);
+
+            void *p = c.bump;
+            c.bump += c.size;
+            return p;
+        }
+        #endif
+
+        return ::operator new(n);
     }
 
-    // A utility function that displays gclist
-    static void showlist();
+    // Return a block of n bytes made by allocate(n)
+    static void deallocate(void *p, size_t n) {
 
-    // Clear gclist when program exits
-    static void shutdown();
+        #ifndef GC_NO_POOL
+        if (n <= MAX_SMALL) {
 
-    };
+            State &s = state();
+            Class &c = s.classes[s.classOf[index(n)]];
+            lock_guard<GCMutex> guard(c.mutex);
 
-    // Create a storage for the static variables
-    template <class T, int size>
-    list<GCInfo<T>> GCPtr<T, size>::gclist;
+            Block *b = (Block *) p;
+            b->next = c.free;
+            c.free = b;
+            return;
+        }
+        #else
+        (void) n;
+        #endif
 
-    template <class T, int size>
-    bool GCPtr<T, size>::first = true;
+        ::operator delete(p);
+    }
 
-    // Destructor for GCPtr
-    template <class T, int size>
-    GCPtr<T, size>::~GCPtr() {
+    // Return the number of bytes held in slabs
+    static size_t slabBytes() {
+
+        Arena &a = state().arena;
+        lock_guard<GCMutex> guard(a.mutex);
 
-        typename list<GCInfo<T>>::iterator p;
+        return a.slabs * SLAB_SIZE;
+    }
 
-        p = findPtrInfo(addr);
-        if (p->refcount) p->refcount--; // decrement red count
+    // If p lies in a block of a slab, return the start of the
+    // block. Otherwise return NULL.
+    static void *blockOf(const void *p) {
 
-        #ifdef DISPLAY
-            cout << "GCPtr pointer out of scope.\n";
-        #endif
+        #ifndef GC_NO_POOL
+        Arena &a = state().arena;
+        lock_guard<GCMutex> guard(a.mutex);
 
-        // Collect garbage when a pointer is out of scope
-        collect();
+        const char *slab = (const char *) ((uintptr_t) p & ~(uintptr_t) (SLAB_SIZE - 1));
+        size_t *size = a.sizes.find(slab);
 
+        if (size) {
+            size_t offset = (const char *) p - slab;
+            return (void *) (slab + offset / *size * *size);
+        }
+        #else
+        (void) p;
+        #endif
 
-        // For real use, you might want to collect unused memory less frequently
-        // such as after gclist has reached a certain size, after a certain number
-        // of GCPtrs have gone out of scope, or when memory is low.
+        return NULL;
     }
 
-    // Collect garbage. Return true if at least one object was freed
-    template <class T, int size>
-    bool GCPtr<T, size>::collect() {
-        bool memFreed = false;
+private:
 
-        #ifdef DISPLAY
-            cout << "Before garbage collection for ";
-            showlist();
-        #endif
+    // Block sizes are multiples of GRANULE, which keeps every block
+    // aligned for any object make_gc() accepts
+    static const size_t GRANULE = 16;
 
-        typename list<GCInfo<T>>::iterator p;
+    static_assert(GRANULE % alignof(std::max_align_t) == 0,
+                  "GCPool blocks must be aligned for any type");
 
-        do {
-            // Scan gclist looking for unreferenced pointers.
-            for (p = gclist.begin(); p != gclist.end(); p++) {
-                // if in-use skip
-                if (p->refcount > 0) continue;
+    // The largest number of size classes
+    static const unsigned MAX_CLASSES = 64;
+
+    // A free block. Its first bytes link it to the next free block.
+    struct Block {
+        Block *next;
+    };
 
-                memFreed = true;
+    struct Class {
+        size_t size; // bytes in each block
+        Block *free; // first free block, NULL if there is none
+        char *bump; // the next block never handed out
+        char *end; // the end of the slab bump points into
+        GCMutex mutex; // guards the above
 
-                // Remove unused entry from gclist
-                gclist.remove(*p);
+        Class() : size(0), free(NULL), bump(NULL), end(NULL) {}
+    };
+
+    // Where slabs come from
+    struct Arena {
+        char *next; // the next unused slab
+        char *end; // the end of the memory next points into
+        size_t slabs; // slabs handed out
+        GCIndex<const char *, size_t> sizes; // block size in each slab
+        GCMutex mutex; // guards the above
 
-                // Free memory unless the GCPtr is null
-                if (p->memPtr) {
+        Arena() : next(NULL), end(NULL), slabs(0) {}
+    };
 
-                    if (p->isArray) {
+    struct State {
+        Class classes[MAX_CLASSES];
+        unsigned count; // size classes in use
+        Arena arena;
 
-                    #ifdef DISPLAY
-                        cout << "Deleting array of size "
-                        << p->arraySize << endl;
-                    #endif
+        // The class for each multiple of GRANULE up to MAX_SMALL
+        unsigned char classOf[MAX_SMALL / GRANULE];
 
-                        delete[] p->memPtr; // delete array
+        // Sizes step by GRANULE up to 128 bytes, then by a
+        // quarter of the power of two below them
+        State() {
 
-                    } else {
-                        #ifdef DISPLAY
-                            cout << "Deleting: "
-                            << *(T *) p->memPtr << "\n";
-                        #endif
-                        delete p->memPtr; // delete single element
-                    }
+            size_t size = 0;
+            size_t step = GRANULE;
+
+            count = 0;
+            for (size_t i = 0; i < MAX_SMALL / GRANULE; ++i) {
+
+                if ((i + 1) * GRANULE > size) {
+                    size += step;
+                    if (size >= 128 && (size & (size - 1)) == 0) step = size / 4;
+                    classes[count++].size = size;
                 }
-                // Restart the search
-                break;
+                classOf[i] = (unsigned char) (count - 1);
             }
-        } while(p != gclist.end());
+        }
+    };
 
-        #ifdef DISPLAY
-            cout << "After garbage collection for ";
-            showlist();
-        #endif
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
 
-        return memFreed;
+    // Return the position in classOf of a request for n bytes
+    static size_t index(size_t n) {
+        return n ? (n - 1) / GRANULE : 0;
     }
 
-    // Overload assignment of pointer to GCPtr.
-    template <class T, int size>
-    T * GCPtr<T, size>::operator=(T *t) {
+    // Point c at a new slab. c.mutex must be held.
+    static void newSlab(Class &c) {
 
-        typename list<GCInfo<T>>::iterator p;
+        Arena &a = state().arena;
+        lock_guard<GCMutex> guard(a.mutex);
 
-        // First, decrement the reference count
-        // for the memory currently being pointed to
-        p = findPtrInfo(addr);
-        p->refcount--;
+        // Take ARENA_SLABS slabs at once, with room to align the first
+        if (a.next == a.end) {
+            char *mem = (char *) ::operator new((ARENA_SLABS + 1) * SLAB_SIZE);
+            uintptr_t first = ((uintptr_t) mem + SLAB_SIZE - 1) & ~(uintptr_t) (SLAB_SIZE - 1);
 
-        // Next, if te new address is already existent in the system,
-        // increment its count. Otherwise, create a new entry for gclist
-        p = findPtrInfo(t);
-        if (p != gclist.end()) {
+            a.next = (char *) first;
+            a.end = a.next + ARENA_SLABS * SLAB_SIZE;
+        }
 
-            p->refcount++;
-        } else {
+        // The end of the old slab too short for another block is left unused
+        c.bump = a.next;
+        c.end = a.next + SLAB_SIZE / c.size * c.size;
+        a.next += SLAB_SIZE;
+        a.slabs++;
 
-            // Create and store this entry
-            GCInfo<T> gcObj(t, size);
-            gclist.push_front(gcObj);
-        }
+        a.sizes.insert(c.bump, c.size);
+    }
+};
 
-        addr = t; // store the address
+// This class defines an element that is stored in the
+// garbage collection information list
+template <class T> class GCInfo : public GCInfoBase {
 
-        return t;
+public:
+
+    T *memPtr; // Pointer to the allocated memory
+
+    // Links to the neighbouring entries in gclist
+    GCInfo *prev;
+    GCInfo *next;
+
+    // Here, mPtr points to the allocated memory.
+    // Of this is an array, then size specifies
+    // the size of the array
+    GCInfo(T *mPtr, unsigned size = 0) : GCInfoBase(size) {
+        memPtr = mPtr;
+        prev = next = NULL;
     }
 
-    // Overload assignment of GCPtr to GCPtr.
-    template <class T, int size>
-    GCPtr<T, size> & GCPtr<T, size>::operator=(GCPtr &rv) {
+    // Return the number of bytes of managed memory this entry accounts for
+    size_t bytes() const {
+        if (!memPtr) return 0;
+        return sizeof(T) * (isArray ? arraySize : 1);
+    }
+
+    // Allocate an entry followed by uninitialized room for n objects of
+    // type T in a single block from GCPool. memPtr points just past the entry.
+    static GCInfo *allocateBlock(unsigned n, bool array) {
 
-        typename list<GCInfo<T>>::iterator p;
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "make_gc does not support over-aligned types");
 
-        // First decrement the reference count
-        // for the memory currently being pointed to.
-        p = findPtrInfo(addr);
-        p->refcount--;
+        void *mem = GCPool::allocate(blockSize(n));
+        GCInfo *p = new (mem) GCInfo((T *) ((char *) mem + blockOffset()));
 
-        // Next, increment the reference count of the new address
-        p = findPtrInfo(rv.addr);
-        p->refcount++; // increment the count
+        p->isArray = array;
+        p->arraySize = array ? n : 0;
+        p->coLocated = true;
+        return p;
+    }
 
-        addr = rv.addr; // store the address.
+    // Free a block made by allocateBlock() whose objects are not constructed
+    static void deallocateBlock(GCInfo *p) {
 
-        return rv;
+        size_t bytes = blockSize(p->isArray ? p->arraySize : 1);
+
+        p->~GCInfo();
+        GCPool::deallocate(p, bytes);
     }
 
-    // A utility function that displays gclist
-    template <class T, int size>
-    void GCPtr<T, size>::showlist() {
+    // Call gcTrace(v) on each managed object, if T declares it
+    static void trace(GCInfoBase *b, GCVisitor &v) {
+        traceObjects(static_cast<GCInfo *>(b), v,
+                     integral_constant<bool, GCTraceable<T>::value>());
+    }
 
-        typename list<GCInfo<T>>::iterator p;
+    // Destroy the managed memory. The entry itself stays valid until
+    // freeEntry() is called, so the destructors run here may still
+    // drop references to other entries that are being freed.
+    static void destroyObject(GCInfoBase *b) {
 
-        cout << "gclist<" << typeid(T).name() << ", "
-        << size << ">: \n";
-        cout << "memPtr     recount         value\n";
+        GCInfo *p = static_cast<GCInfo *>(b);
 
-        if (gclist.begin() == gclist.end()) {
-            cout << "      -- Empty --\n\n";
+        if (p->coLocated) {
+            // The objects live in this entry's block, so only
+            // run their destructors. freeEntry() frees the block.
+            for (unsigned i = p->isArray ? p->arraySize : 1; i > 0; --i) {
+                p->memPtr[i - 1].~T();
+            }
             return;
         }
 
-        for (p = gclist.begin(); p != gclist.end(); p++) {
+        // Free memory unless the GCPtr is null
+        if (p->memPtr) {
+            if (p->isArray) delete[] p->memPtr; // delete array
+            else delete p->memPtr; // delete single element
+        }
+    }
 
-            cout << " [" << (void *)p->memPtr << "]"
-            << "        " << p->refcount << "       ";
+    // Release an entry whose memory was destroyed by destroyObject()
+    static void freeEntry(GCInfoBase *b) {
 
-            if (p->memPtr) cout << "    " << *p->memPtr;
-            else cout << "   ---";
-            cout << endl;
-        }
-        cout << endl;
+        GCInfo *p = static_cast<GCInfo *>(b);
+
+        if (p->coLocated) deallocateBlock(p);
+        else delete p;
     }
 
-    // Find a pointer in gclist.
-    template <class T, int size>
-    typename list<GCInfo<T>>::iterator
-    GCPtr<T, size>::findPtrInfo(T *ptr) {
+    // Display the managed memory before it is deleted
+    static void show(GCInfoBase *b) {
 
-        typename list<GCInfo<T>>::iterator p;
+        #ifdef DISPLAY
+        GCInfo *p = static_cast<GCInfo *>(b);
 
-        // Find pointer in gclist
-        for (p = gclist.begin(); p != gclist.end(); p++) {
-            if (p->memPtr == ptr) {
-                return p;
+        if (p->memPtr) {
+            if (p->isArray) {
+                cout << "Deleting array of size "
+                << p->arraySize << endl;
+            } else {
+                cout << "Deleting: "
+                << *(T *) p->memPtr << "\n";
             }
         }
-        return p;
+        #else
+        (void) b;
+        #endif
     }
 
-    // Clear gclist when program exits
-    template <class T, int size>
-    void GCPtr<T, size>::shutdown() {
+private:
+    static void traceObjects(GCInfo *p, GCVisitor &v, true_type) {
+        if (!p->memPtr) return;
+        for (unsigned i = 0; i < (p->isArray ? p->arraySize : 1); ++i) {
+            p->memPtr[i].gcTrace(v);
+        }
+    }
 
-        if (gclistSize() == 0) return; // list is empty
+    static void traceObjects(GCInfo *, GCVisitor &, false_type) {}
 
-        typename list<GCInfo<T>>::iterator p;
+    // Return the distance from the start of a block to its first object
+    static size_t blockOffset() {
+        return (sizeof(GCInfo) + alignof(T) - 1) / alignof(T) * alignof(T);
+    }
 
-        for (p == gclist.begin(); p != gclist.end(); p++) {
+    // Return the size of a block holding n objects
+    static size_t blockSize(unsigned n) {
+        return blockOffset() + sizeof(T) * n;
+    }
+};
 
-            // Set all ref counts to zero
-            p->refcount = 0;
-        }
+// GCList is the garbage collection information list. Entries
+// carry their own links, so adding or removing one does not
+// allocate and the entry can share a block with its object.
+template <class T> class GCList {
 
-        #ifdef DISPLAY
-            cout << "Before collecting for shutdown() for "
-            << typeid(T).name() << "\n";
-        #endif
+    GCInfo<T> *head; // first entry, NULL if empty
+    size_t count; // number of entries
 
-        collect();
+public:
+    constexpr GCList() : head(NULL), count(0) {}
 
-        #ifdef DISPLAY
-            cout << "After collecting for shutdown() for "
-            << typeid(T).name() << "\n";
-        #endif
+    // Return the first entry, or NULL if the list is empty
+    GCInfo<T> *front() const { return head; }
+
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    // Add p at the start of the list
+    void push_front(GCInfo<T> *p) {
+        p->prev = NULL;
+        p->next = head;
+        if (head) head->prev = p;
+        head = p;
+        count++;
+    }
+
+    // Unlink p from the list
+    void erase(GCInfo<T> *p) {
+        if (p->prev) p->prev->next = p->next;
+        else head = p->next;
+        if (p->next) p->next->prev = p->prev;
+        p->prev = p->next = NULL;
+        count--;
+    }
+};
+
+// GCPolicy decides when a GCPtr type collects garbage on its own.
+// The policy is consulted whenever a GCPtr goes out of scope and
+// whenever a new object is added to gclist. A collection is only
+// started when at least one entry has become unreferenced.
+//
+// Only a full sweep finds old garbage, and it scans all of gclist, so
+// IMMEDIATE lets old garbage wait until it makes up a fraction of
+// gclist (see GCPtr::OLD_SHARE) rather than sweeping on each release.
+//
+// In tracing mode nothing is known about references until a collection
+// runs, so the policy is consulted only before a new object is added,
+// and the entries and bytes added since the last collection stand in
+// for unreferenced ones. The default there is PACED.
+class GCPolicy {
+
+public:
+    enum Kind {
+        IMMEDIATE, // collect as soon as any young entry is unreferenced
+        ENTRY_THRESHOLD, // collect once limit entries are unreferenced
+        BYTE_THRESHOLD, // collect once limit bytes are unreferenced
+        PACED, // collect once managed memory grows by limit percent
+        MANUAL // only collect when collect() is called
+    };
+
+    Kind kind; // which rule to apply
+
+    // Meaning depends on kind: an entry count, a byte count
+    // or a growth percentage. Unused by IMMEDIATE and MANUAL.
+    size_t limit;
+
+    // PACED never collects while managed memory is below this many bytes
+    static const size_t PACED_MIN_BYTES = 4 * 1024 * 1024;
+
+    constexpr GCPolicy(Kind k = IMMEDIATE, size_t l = 0) : kind(k), limit(l) {}
+
+    static GCPolicy immediate() { return GCPolicy(IMMEDIATE); }
+    static GCPolicy entries(size_t n) { return GCPolicy(ENTRY_THRESHOLD, n); }
+    static GCPolicy bytes(size_t n) { return GCPolicy(BYTE_THRESHOLD, n); }
+    static GCPolicy paced(size_t percent = 100) { return GCPolicy(PACED, percent); }
+    static GCPolicy manual() { return GCPolicy(MANUAL); }
+
+    // A policy that may be changed while other threads read it. It is
+    // kept in one word, the limit above the three bits of the kind, so
+    // in thread-safe mode a read needs no lock and never sees half a
+    // change. A limit too large for the rest of the word is clamped.
+    class Shared {
+
+    public:
+        // constexpr, so a GCPtr made by a static constructor in
+        // another file never sees the word before it is set
+        constexpr Shared() : word(NONE) {}
+
+        explicit Shared(const GCPolicy &p) : word(pack(p)) {}
+
+        // Set p to the policy and return true, or return
+        // false if no policy is stored
+        bool load(GCPolicy &p) const {
+
+            size_t w = word;
+
+            if (w == NONE) return false;
+            p = GCPolicy((Kind) (w & 7), w >> 3);
+            return true;
+        }
+
+        void store(const GCPolicy &p) {
+            word = pack(p);
+        }
+
+        // Forget the policy stored
+        void clear() {
+            word = NONE;
+        }
+
+    private:
+        static const size_t NONE = 7; // not a Kind, so no policy
+        GCCounter word;
+
+        static size_t pack(const GCPolicy &p) {
+            size_t most = (size_t) -1 >> 3;
+            return (p.limit < most ? p.limit : most) << 3 | p.kind;
+        }
+    };
+
+    // Return the policy used by GCPtr types that have not set their own
+    static GCPolicy global() {
+
+        GCPolicy p;
+
+        globalPolicy().load(p);
+        return p;
+    }
+
+    // Change the policy used by GCPtr types that have not set their own
+    static void setGlobal(const GCPolicy &p) {
+        globalPolicy().store(p);
+    }
+
+    // Return true if a collection should run. pendingEntries and pendingBytes
+    // describe entries that became unreferenced since the last collection,
+    // liveBytes is the managed memory now and lastLiveBytes the managed
+    // memory left after the last collection.
+    bool shouldCollect(size_t pendingEntries, size_t pendingBytes,
+                       size_t liveBytes, size_t lastLiveBytes) const {
+
+        if (!pendingEntries) return false; // nothing to free
+
+        switch (kind) {
+            case IMMEDIATE:
+                return true;
+            case ENTRY_THRESHOLD:
+                return pendingEntries >= limit;
+            case BYTE_THRESHOLD:
+                return pendingBytes >= limit;
+            case PACED: {
+                size_t target = lastLiveBytes + lastLiveBytes / 100 * limit;
+                if (target < PACED_MIN_BYTES) target = PACED_MIN_BYTES;
+                return liveBytes >= target;
+            }
+            case MANUAL:
+            default:
+                return false;
+        }
+    }
+
+private:
+    static Shared &globalPolicy() {
+    #ifdef GC_TRACING
+        static Shared policy(GCPolicy(PACED, 100));
+    #else
+        static Shared policy((GCPolicy()));
+    #endif
+        return policy;
+    }
+};
+
+// A collector event recorded by GCTrace
+struct GCTraceEvent {
+    unsigned long long time; // steady clock time in nanoseconds
+    const void *entry; // the gclist entry concerned, or NULL
+    size_t value; // the reference count, or the pause at COLLECT_END
+    unsigned thread; // the ring the event was recorded in
+    unsigned char kind; // a GCTrace::Kind
+};
+
+#ifdef GC_TRACE_EVENTS
+// GCTrace records collector events without taking a lock or writing
+// output. Each thread has a ring of its own that only it writes, and
+// drain() or a drainer thread started with start() empties the rings.
+// An event that finds its ring full is dropped and counted.
+//
+// Without GC_TRACE_EVENTS, GC_TRACE() expands to nothing.
+class GCTrace {
+
+public:
+
+    enum Kind {
+        CONSTRUCT, // a GCPtr was made from a pointer or by make_gc()
+        COPY, // a GCPtr was copied
+        ASSIGN, // a GCPtr was assigned to
+        DESTRUCT, // a GCPtr holding a reference was destroyed
+        FREE, // a managed object is being destroyed
+        COLLECT_BEGIN,
+        COLLECT_END
+    };
+
+    // Events each ring holds. A power of two.
+    static const size_t RING_SIZE = 4096;
+
+    // Receives drained events
+    typedef void (*Sink)(const GCTraceEvent &e);
+
+    static void record(Kind kind, const void *entry, size_t value) {
+
+        Ring &r = local();
+        size_t head = r.head.load(memory_order_relaxed);
+
+        if (head - r.tail.load(memory_order_acquire) == RING_SIZE) {
+            r.dropped.store(r.dropped.load(memory_order_relaxed) + 1,
+                            memory_order_relaxed);
+            return;
+        }
+
+        GCTraceEvent &e = r.events[head & (RING_SIZE - 1)];
+        e.time = (unsigned long long) chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+        e.entry = entry;
+        e.value = value;
+        e.thread = r.id;
+        e.kind = (unsigned char) kind;
+
+        r.head.store(head + 1, memory_order_release);
+    }
+
+    // Pass every event recorded so far to sink, ring by ring.
+    // Return the number of events passed.
+    static size_t drain(Sink sink) {
+
+        State &s = state();
+        lock_guard<mutex> draining(s.drainMutex);
+        size_t n = 0;
+
+        for (Ring *r = first(); r; r = r->next) {
+
+            size_t tail = r->tail.load(memory_order_relaxed);
+            size_t head = r->head.load(memory_order_acquire);
+
+            for (; tail != head; ++tail, ++n) {
+                sink(r->events[tail & (RING_SIZE - 1)]);
+            }
+            r->tail.store(tail, memory_order_release);
+        }
+        return n;
+    }
+
+    // Drain into sink on a thread of its own every interval,
+    // if no drainer is running already
+    static void start(Sink sink, chrono::milliseconds interval =
+                                         chrono::milliseconds(10)) {
+
+        State &s = state();
+        lock_guard<mutex> guard(s.drainerMutex);
+
+        if (s.running) return;
+        s.sink = sink;
+        s.interval = interval;
+        s.running = true;
+        s.drainer = thread(run);
+    }
+
+    // Stop the drainer thread, after it has drained once more
+    static void stop() {
+
+        State &s = state();
+        {
+            lock_guard<mutex> guard(s.drainerMutex);
+            if (!s.running) return;
+            s.running = false;
+        }
+        s.cv.notify_one();
+        s.drainer.join();
+    }
+
+    // Return the number of events dropped because a ring was full
+    static size_t dropped() {
+
+        size_t n = 0;
+        for (Ring *r = first(); r; r = r->next) {
+            n += r->dropped.load(memory_order_relaxed);
+        }
+        return n;
+    }
+
+    static const char *name(unsigned char kind) {
+        static const char *names[] = {
+            "construct", "copy", "assign", "destruct",
+            "free", "collect_begin", "collect_end"
+        };
+        return kind <= COLLECT_END ? names[kind] : "unknown";
+    }
+
+private:
+
+    // Events of one thread. head is written only by the thread
+    // that owns the ring and tail only by a drain.
+    struct Ring {
+        GCTraceEvent events[RING_SIZE];
+        atomic<size_t> head; // events recorded
+        atomic<size_t> tail; // events drained
+        atomic<size_t> dropped;
+        unsigned id;
+        Ring *next; // the next ring in the list of all rings
+        Ring *nextFree; // the next unowned ring
+
+        Ring() : head(0), tail(0), dropped(0), id(0), next(NULL), nextFree(NULL) {}
+    };
+
+    struct State {
+        atomic<Ring *> all; // every ring ever made
+        Ring *free; // rings whose thread has exited
+        unsigned rings;
+        std::mutex lock; // guards free and rings, and pushes onto all
+        std::mutex drainMutex; // held by drain()
+        std::mutex drainerMutex; // guards the fields below
+        condition_variable cv;
+        thread drainer;
+        Sink sink;
+        chrono::milliseconds interval;
+        bool running;
+
+        State() : all(NULL), free(NULL), rings(0), sink(NULL),
+                  interval(10), running(false) {}
+    };
+
+    // The rings are never freed either, like the state
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
+
+    // Rings are only ever added at the front, so the
+    // list can be walked without the mutex
+    static Ring *first() {
+        return state().all.load(memory_order_acquire);
+    }
+
+    // Take an unowned ring, or make a new one
+    static Ring *acquire() {
+
+        State &s = state();
+        lock_guard<std::mutex> guard(s.lock);
+
+        Ring *r = s.free;
+        if (r) {
+            s.free = r->nextFree;
+        } else {
+            r = new Ring;
+            r->id = s.rings++;
+            r->next = s.all.load(memory_order_relaxed);
+            s.all.store(r, memory_order_release);
+        }
+        return r;
+    }
+
+    // Hand r on to the next thread. What it holds is still drained.
+    static void giveBack(Ring *r) {
+
+        State &s = state();
+        lock_guard<std::mutex> guard(s.lock);
+
+        r->nextFree = s.free;
+        s.free = r;
+    }
+
+    // Return the ring of the calling thread. As with GCMetrics, a
+    // thread recording after its exit handler has run keeps a ring.
+    static Ring &local() {
+
+        struct Owner {
+            Ring *r;
+            ~Owner() {
+                giveBack(r);
+                mine() = NULL;
+            }
+        };
+
+        Ring *&r = mine();
+        if (!r) {
+            r = acquire();
+            static thread_local Owner owner = { r };
+        }
+        return *r;
+    }
+
+    static Ring *&mine() {
+        static thread_local Ring *r = NULL;
+        return r;
+    }
+
+    // The body of the drainer thread
+    static void run() {
+
+        State &s = state();
+        unique_lock<std::mutex> guard(s.drainerMutex);
+
+        while (s.running) {
+            s.cv.wait_for(guard, s.interval);
+
+            Sink sink = s.sink;
+            guard.unlock();
+            drain(sink);
+            guard.lock();
+        }
+    }
+};
+
+#define GC_TRACE(kind, entry, value) \
+    GCTrace::record(GCTrace::kind, entry, value)
+#else
+#define GC_TRACE(kind, entry, value) ((void) 0)
+#endif
+
+// GCMetrics counts what the collectors do. Each thread counts into a
+// block of its own, and the blocks are summed only when the counts are
+// read, so counting costs no more than an unshared add. Define
+// GC_NO_STATS to leave the counting out. The counts of reference count
+// changes and gcindex searches are paid on every copy of a GCPtr, so
+// they are only kept if GC_OP_STATS is defined.
+class GCMetrics {
+
+public:
+
+    // Pauses are kept in a histogram whose bucket i
+    // holds those of 2^i to 2^(i+1) - 1 nanoseconds
+    static const unsigned BUCKETS = 48;
+
+    // The counts of one thread
+    struct Counters {
+        GCStat collections;
+        GCStat objectsFreed;
+        GCStat bytesFreed;
+        GCStat increments; // reference counts raised
+        GCStat decrements; // reference counts dropped
+        GCStat lookups; // searches of a gcindex
+        GCStat maxPause; // in nanoseconds
+        GCStat pauses[BUCKETS];
+        Counters *next; // the next block in the list of all blocks
+        Counters *nextFree; // the next unowned block
+
+        Counters() : collections(0), objectsFreed(0), bytesFreed(0),
+                     increments(0), decrements(0), lookups(0),
+                     maxPause(0), next(NULL), nextFree(NULL) {
+            for (unsigned i = 0; i < BUCKETS; ++i) pauses[i] = 0;
+        }
+    };
+
+    #ifdef GC_OP_STATS
+    static void increment() { add(&Counters::increments, 1); }
+    static void decrement() { add(&Counters::decrements, 1); }
+    static void lookup() { add(&Counters::lookups, 1); }
+    #else
+    static void increment() {}
+    static void decrement() {}
+    static void lookup() {}
+    #endif
+
+    static void freed(size_t bytes) {
+        add(&Counters::objectsFreed, 1);
+        add(&Counters::bytesFreed, bytes);
+    }
+
+    // Times a collection from its construction to its destruction.
+    // Collections nest, as when collect() runs the cycle collector
+    // after a sweep, so only the outermost Pause on a thread counts.
+    class Pause {
+    public:
+        #if !defined(GC_NO_STATS) || defined(GC_TRACE_EVENTS)
+        Pause() : outer(depth()++ == 0) {
+            if (!outer) return;
+
+            start = chrono::steady_clock::now();
+            GC_TRACE(COLLECT_BEGIN, NULL, 0);
+        }
+
+        ~Pause() {
+            depth()--;
+            if (!outer) return;
+
+            chrono::nanoseconds t = chrono::steady_clock::now() - start;
+            GC_TRACE(COLLECT_END, NULL, (size_t) t.count());
+
+            #ifndef GC_NO_STATS
+            record((size_t) t.count());
+            #endif
+        }
+
+    private:
+        bool outer; // true if no other Pause was running on this thread
+        chrono::steady_clock::time_point start;
+
+        // Return the number of Pauses running on this thread
+        static unsigned &depth() {
+            #ifdef GC_THREAD_SAFE
+            static thread_local unsigned d = 0;
+            #else
+            static unsigned d = 0;
+            #endif
+            return d;
+        }
+        #else
+        Pause() {}
+        #endif
+    };
+
+    // Add the counts of every thread into total
+    static void sum(Counters &total) {
+
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+
+        for (Counters *c = s.all; c; c = c->next) {
+            total.collections += load(c->collections);
+            total.objectsFreed += load(c->objectsFreed);
+            total.bytesFreed += load(c->bytesFreed);
+            total.increments += load(c->increments);
+            total.decrements += load(c->decrements);
+            total.lookups += load(c->lookups);
+            if (load(c->maxPause) > load(total.maxPause)) {
+                total.maxPause = load(c->maxPause);
+            }
+            for (unsigned i = 0; i < BUCKETS; ++i) {
+                total.pauses[i] += load(c->pauses[i]);
+            }
+        }
+    }
+
+private:
+
+    struct State {
+        Counters *all; // every block ever made
+        Counters *free; // blocks whose thread has exited
+        GCMutex mutex; // guards the above
+
+        State() : all(NULL), free(NULL) {}
+    };
+
+    // The blocks are never freed either, like the state
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
+
+    static size_t load(const GCStat &c) {
+        #ifdef GC_THREAD_SAFE
+        return c.load(memory_order_relaxed);
+        #else
+        return c;
+        #endif
+    }
+
+    // Only the owning thread writes a block, so
+    // the add needs no atomic read-modify-write
+    static void store(GCStat &c, size_t n) {
+        #ifdef GC_THREAD_SAFE
+        c.store(n, memory_order_relaxed);
+        #else
+        c = n;
+        #endif
+    }
+
+    static void add(GCStat Counters::*c, size_t n) {
+        #ifndef GC_NO_STATS
+        Counters &mine = local();
+        store(mine.*c, load(mine.*c) + n);
+        #else
+        (void) c;
+        (void) n;
+        #endif
+    }
+
+    static void record(size_t ns) {
+
+        Counters &mine = local();
+        unsigned bucket = 0;
+
+        while (bucket + 1 < BUCKETS && ns >> (bucket + 1)) bucket++;
+
+        store(mine.collections, load(mine.collections) + 1);
+        store(mine.pauses[bucket], load(mine.pauses[bucket]) + 1);
+        if (ns > load(mine.maxPause)) store(mine.maxPause, ns);
+    }
+
+    // Take an unowned block, or make a new one
+    static Counters *acquire() {
+
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+
+        Counters *c = s.free;
+        if (c) {
+            s.free = c->nextFree;
+        } else {
+            c = new Counters;
+            c->next = s.all;
+            s.all = c;
+        }
+        return c;
+    }
+
+    // Hand c on to the next thread. Its counts stay in the sum.
+    static void giveBack(Counters *c) {
+
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+
+        c->nextFree = s.free;
+        s.free = c;
+    }
+
+    #ifdef GC_THREAD_SAFE
+    // Return the block of the calling thread. A thread that counts
+    // again after its exit handler has run, as the main thread may
+    // during static destruction, gets a block it keeps for good.
+    static Counters &local() {
+
+        struct Owner {
+            Counters *c;
+            ~Owner() {
+                giveBack(c);
+                mine() = NULL;
+            }
+        };
+
+        Counters *&c = mine();
+        if (!c) {
+            c = acquire();
+            static thread_local Owner owner = { c };
+        }
+        return *c;
+    }
+
+    static Counters *&mine() {
+        static thread_local Counters *c = NULL;
+        return c;
+    }
+    #else
+    static Counters &local() {
+        static Counters *c = acquire();
+        return *c;
+    }
+    #endif
+};
+
+// What the collectors have done, as returned by GCHeap::stats()
+struct GCStats {
+
+    // The managed objects of one GCPtr type
+    struct Type {
+        const char *name; // the name of the type from typeid
+        size_t objects; // entries in its gclist
+        size_t bytes; // managed memory they refer to
+    };
+
+    size_t collections; // sweeps, slices and collections run
+    size_t objectsFreed;
+    size_t bytesFreed;
+    size_t liveObjects; // entries in all gclists
+    size_t liveBytes;
+    size_t increments; // reference counts raised, with GC_OP_STATS
+    size_t decrements; // reference counts dropped, with GC_OP_STATS
+    size_t lookups; // searches of a gcindex, with GC_OP_STATS
+
+    // The number of pauses of 2^i to 2^(i+1) - 1 nanoseconds
+    size_t pauses[GCMetrics::BUCKETS];
+
+    chrono::nanoseconds pauseP50;
+    chrono::nanoseconds pauseP99;
+    chrono::nanoseconds pauseMax;
+
+    vector<Type> types;
+
+    // Return a bound on the pause that fraction q of the collections
+    // did not exceed. It is exact only to a power of two.
+    chrono::nanoseconds percentile(double q) const {
+
+        size_t total = 0;
+        for (unsigned i = 0; i < GCMetrics::BUCKETS; ++i) total += pauses[i];
+        if (total == 0) return chrono::nanoseconds(0);
+
+        size_t wanted = (size_t) (q * total + 0.5);
+        size_t seen = 0;
+        unsigned i = 0;
+
+        for (; i + 1 < GCMetrics::BUCKETS; ++i) {
+            seen += pauses[i];
+            if (seen >= wanted && seen > 0) break;
+        }
+
+        chrono::nanoseconds bound(((long long) 2 << i) - 1);
+        return bound < pauseMax ? bound : pauseMax;
+    }
+};
+
+// GCHeap keeps a record of every GCPtr type in use, so collection,
+// memory accounting and shutdown can cover all managed objects at once.
+// Entries carry their own operations, so garbage of different types
+// is destroyed and freed together.
+class GCHeap {
+
+public:
+
+    // Which entries unlinkEntries() takes out of a gclist
+    enum Which {
+        UNREFERENCED, // entries whose reference count is zero
+        YOUNG_UNREFERENCED, // young entries whose reference count is zero
+        UNMARKED, // entries a mark-sweep collection did not reach
+        YOUNG_UNMARKED, // young entries a minor collection did not reach
+        ALL // every entry, at shutdown
+    };
+
+    // The operations of one GCPtr type
+    struct Space {
+        // Move the entries selected by which from gclist to garbage
+        size_t (*unlinkEntries)(vector<GCInfoBase *> &garbage, Which which);
+        int (*entries)(); // number of entries in gclist
+        size_t (*liveBytes)(); // managed memory referenced from gclist
+        bool (*sweepPending)(); // sweep if anything became unreferenced
+        const char *(*name)(); // the name of the type
+    };
+
+    // Add the GCPtr type described by s
+    static void addSpace(const Space *s) {
+
+        registerShutdown();
+
+        State &st = state();
+        lock_guard<GCMutex> guard(st.mutex);
+
+        st.spaces.push_back(s);
+    }
+
+    // Register shutdown() as an exit function, once. Exit functions
+    // registered after this one run before it.
+    static void registerShutdown() {
+
+        State &st = state();
+        lock_guard<GCMutex> guard(st.mutex);
+
+        if (st.registered) return;
+        st.registered = true;
+        std::atexit(shutdown);
+    }
+
+    // Unlink the entries selected by which from every gclist into
+    // garbage. Return the number of entries unlinked.
+    static size_t unlinkAll(vector<GCInfoBase *> &garbage, Which which) {
+
+        size_t before = garbage.size();
+        vector<const Space *> spaces = snapshot();
+
+        for (size_t i = 0; i < spaces.size(); ++i) {
+            spaces[i]->unlinkEntries(garbage, which);
+        }
+        return garbage.size() - before;
+    }
+
+    // Sweep every GCPtr type that has unreferenced entries.
+    // Return true if at least one object was freed.
+    static bool sweepPending() {
+
+        vector<const Space *> spaces = snapshot();
+        bool freed = false;
+
+        for (size_t i = 0; i < spaces.size(); ++i) {
+            if (spaces[i]->sweepPending()) freed = true;
+        }
+        return freed;
+    }
+
+    // Destroy and free unlinked entries. All objects are destroyed
+    // before any entry is released, since a destructor may still
+    // drop a reference to another entry in the garbage.
+    static void release(vector<GCInfoBase *> &garbage) {
+
+        size_t i;
+
+        for (i = 0; i < garbage.size(); ++i) {
+            #ifdef DISPLAY
+            garbage[i]->ops->show(garbage[i]);
+            #endif
+            GC_TRACE(FREE, garbage[i], 0);
+            garbage[i]->ops->destroyObject(garbage[i]);
+        }
+        for (i = 0; i < garbage.size(); ++i) {
+            garbage[i]->ops->freeEntry(garbage[i]);
+        }
+    }
+
+    // Return the number of entries in all gclists
+    static size_t entries() {
+
+        vector<const Space *> spaces = snapshot();
+        size_t n = 0;
+
+        for (size_t i = 0; i < spaces.size(); ++i) n += spaces[i]->entries();
+        return n;
+    }
+
+    // In reference counting mode, a sweep keeps this many of the newest
+    // survivors of each GCPtr type young and promotes the rest, which
+    // bounds the work of a minor sweep
+    static void setYoungLimit(size_t entries) {
+        state().youngLimit = entries;
+    }
+
+    static size_t youngLimit() {
+        return state().youngLimit;
+    }
+
+    // Return the managed memory referenced from all gclists. This
+    // only reads counters, so it is done without copying the spaces.
+    static size_t liveBytes() {
+
+        State &st = state();
+        lock_guard<GCMutex> guard(st.mutex);
+        size_t n = 0;
+
+        for (size_t i = 0; i < st.spaces.size(); ++i) n += st.spaces[i]->liveBytes();
+        return n;
+    }
+
+    // Return what the collectors have done and what is live now
+    static GCStats stats() {
+
+        GCMetrics::Counters c;
+        GCStats st;
+
+        GCMetrics::sum(c);
+
+        st.collections = c.collections;
+        st.objectsFreed = c.objectsFreed;
+        st.bytesFreed = c.bytesFreed;
+        st.increments = c.increments;
+        st.decrements = c.decrements;
+        st.lookups = c.lookups;
+        for (unsigned i = 0; i < GCMetrics::BUCKETS; ++i) st.pauses[i] = c.pauses[i];
+
+        st.pauseMax = chrono::nanoseconds((long long) c.maxPause);
+        st.pauseP50 = st.percentile(0.5);
+        st.pauseP99 = st.percentile(0.99);
+
+        vector<const Space *> spaces = snapshot();
+
+        st.liveObjects = 0;
+        st.liveBytes = 0;
+        for (size_t i = 0; i < spaces.size(); ++i) {
+            GCStats::Type t = { spaces[i]->name(),
+                                (size_t) spaces[i]->entries(),
+                                spaces[i]->liveBytes() };
+            st.types.push_back(t);
+            st.liveObjects += t.objects;
+            st.liveBytes += t.bytes;
+        }
+        return st;
+    }
+
+    // Free every managed object when the program exits. Objects of all
+    // types are destroyed before any entry is freed, so a destructor may
+    // drop a GCPtr of another type whatever order the types were used in.
+    static void shutdown() {
+
+        vector<GCInfoBase *> garbage;
+
+        if (!unlinkAll(garbage, ALL)) return;
+
+        #ifdef DISPLAY
+            cout << "Freeing " << garbage.size() << " objects at shutdown\n";
+        #endif
+
+        release(garbage);
+    }
+
+private:
+
+    struct State {
+        vector<const Space *> spaces; // one per GCPtr type in use
+        GCMutex mutex; // guards spaces and registered
+        GCCounter youngLimit; // see setYoungLimit()
+        bool registered; // true once shutdown() is an exit function
+
+        State() : youngLimit(256), registered(false) {}
+    };
+
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
+
+    // Return a copy of the spaces, so they can be visited
+    // without holding the mutex
+    static vector<const Space *> snapshot() {
+        State &st = state();
+        lock_guard<GCMutex> guard(st.mutex);
+        return st.spaces;
+    }
+};
+
+#ifdef GC_THREAD_SAFE
+// GCBackground sweeps on a thread of its own, so unreferenced objects
+// are destroyed and freed off the threads that use them. Once it has
+// been started, a GCPtr whose policy asks for a collection only wakes
+// it. It also sweeps every interval when nothing wakes it. A thread
+// sweeps for itself only if managed memory has reached the heap limit,
+// or while the collector is paused or stopped.
+class GCBackground {
+
+public:
+
+    // Start the collector thread, if it is not already running
+    static void start(chrono::milliseconds interval =
+                              chrono::milliseconds(100)) {
+
+        State &s = state();
+        lock_guard<mutex> guard(s.lock);
+
+        if (s.running) return;
+
+        // Stop the thread before GCHeap frees what is left at exit
+        GCHeap::registerShutdown();
+        if (!s.registered) {
+            s.registered = true;
+            std::atexit(stop);
+        }
+
+        s.interval = interval;
+        s.running = true;
+        s.paused = false;
+        s.worker = thread(run);
+        s.active = true;
+    }
+
+    // Stop the collector thread and wait for it to finish
+    static void stop() {
+
+        State &s = state();
+        {
+            lock_guard<mutex> guard(s.lock);
+            if (!s.running) return;
+            s.running = false;
+            s.active = false;
+        }
+        s.cv.notify_one();
+        s.worker.join();
+    }
+
+    // Stop collecting until resume() is called. When pause()
+    // returns, no background sweep is in progress.
+    static void pause() {
+
+        State &s = state();
+        unique_lock<mutex> guard(s.lock);
+
+        s.paused = true;
+        s.active = false;
+        s.idle.wait(guard, [&s] { return !s.sweeping; });
+    }
+
+    static void resume() {
+
+        State &s = state();
+        lock_guard<mutex> guard(s.lock);
+
+        s.paused = false;
+        s.active = s.running;
+    }
+
+    // Ask for a sweep. This never blocks.
+    static void wake() {
+
+        State &s = state();
+        if (!s.woken.exchange(true)) s.cv.notify_one();
+    }
+
+    // Return true if the collector is running and not paused
+    static bool active() {
+        return state().active;
+    }
+
+    // Past bytes of managed memory, threads sweep for themselves
+    // rather than wait for the collector. Zero means no limit.
+    static void setHeapLimit(size_t bytes) {
+        state().heapLimit = bytes;
+    }
+
+    static bool overLimit() {
+        size_t limit = state().heapLimit;
+        return limit != 0 && GCHeap::liveBytes() >= limit;
+    }
+
+    // Return the number of sweeps the collector has run
+    static size_t sweeps() {
+        return state().sweeps;
+    }
+
+private:
+
+    struct State {
+        thread worker;
+        mutex lock; // guards the fields that are not atomic
+        condition_variable cv; // signalled to wake the collector
+        condition_variable idle; // signalled when a sweep ends
+        chrono::milliseconds interval;
+        bool running;
+        bool paused;
+        bool sweeping; // true while the collector is sweeping
+        bool registered; // true once stop() is an exit function
+        atomic<bool> active; // running and not paused
+        atomic<bool> woken; // a sweep has been asked for
+        atomic<size_t> heapLimit;
+        atomic<size_t> sweeps;
+
+        State() : interval(100), running(false), paused(false),
+                  sweeping(false), registered(false), active(false),
+                  woken(false), heapLimit(0), sweeps(0) {}
+    };
+
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
+
+    // The body of the collector thread. wake() does not take the
+    // mutex, so a wakeup can be missed; the interval bounds the delay.
+    static void run() {
+
+        State &s = state();
+        unique_lock<mutex> guard(s.lock);
+
+        while (s.running) {
+
+            s.cv.wait_for(guard, s.interval,
+                          [&s] { return s.woken || !s.running; });
+
+            if (!s.running) break;
+            s.woken = false;
+            if (s.paused) continue;
+
+            s.sweeping = true;
+            guard.unlock();
+
+            GCHeap::sweepPending();
+            s.sweeps++;
+
+            guard.lock();
+            s.sweeping = false;
+            s.idle.notify_all();
+        }
+    }
+};
+#endif
+
+// GCCycleCollector reclaims garbage cycles: objects that refer to each
+// other through GCPtrs but can no longer be reached from outside, so
+// their reference counts never drop to zero. It uses trial deletion
+// (Bacon and Rajan, 2001). When a reference to a traceable object is
+// dropped and others remain, the object's entry becomes a candidate
+// root. A pass subtracts the references internal to the subgraph
+// reachable from the candidates; entries left with no references
+// from outside that subgraph are garbage.
+//
+// Each pass works on a copy of the reference counts and may take only
+// some of the candidates, so collection can proceed a slice at a time.
+//
+// In thread-safe mode a pass would race with other threads changing
+// GCPtrs inside managed objects, so it is never started automatically.
+// Call collect() from a point where no other thread does that.
+// Candidates are not recorded in that mode until setBuffering(true),
+// which keeps the collector's lock off the release path; a pass only
+// finds cycles whose references were dropped while recording was on.
+class GCCycleCollector {
+
+public:
+
+    // Record p as a candidate root
+    static void addRoot(GCInfoBase *p) {
+
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+
+        p->color = GCInfoBase::PURPLE;
+        if (p->rootIndex != GCInfoBase::NOT_BUFFERED) return;
+
+        p->rootIndex = s.roots.size();
+        s.roots.push_back(p);
+    }
+
+    // Return true if dropped references are recorded as candidates
+    static bool buffering() {
+        return state().buffering;
+    }
+
+    // Turn the recording of candidate roots on or off. Candidates
+    // already recorded are kept for the next pass.
+    static void setBuffering(bool on) {
+        state().buffering = on;
+    }
+
+    // Forget p as a candidate root. Called before p is freed.
+    static void removeRoot(GCInfoBase *p) {
+
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+
+        unbuffer(s, p);
+    }
+
+    // Run a pass over at most maxRoots candidate roots and free the
+    // garbage cycles found. Return the number of objects freed.
+    static size_t collect(size_t maxRoots = (size_t) -1) {
+
+        State &s = state();
+        vector<GCInfoBase *> roots;
+        vector<GCInfoBase *> garbage;
+        size_t i;
+
+        {
+            lock_guard<GCMutex> guard(s.mutex);
+
+            // Destructors run below may start another collection
+            if (s.running) return 0;
+
+            if (s.roots.empty()) {
+                s.lastFreed = 0;
+                return 0;
+            }
+            s.running = true;
+        }
+
+        // Only a pass with candidates to examine counts as a collection
+        GCMetrics::Pause pause;
+
+        {
+            lock_guard<GCMutex> guard(s.mutex);
+
+            // Take candidates off the end of the buffer. One whose count
+            // has dropped to zero is left for the normal sweep to free.
+            while (!s.roots.empty() && roots.size() < maxRoots) {
+
+                GCInfoBase *p = s.roots.back();
+                unbuffer(s, p);
+
+                if (p->color == GCInfoBase::PURPLE && p->refcount > 0) {
+                    roots.push_back(p);
+                } else {
+                    p->color = GCInfoBase::BLACK;
+                }
+            }
+
+            for (i = 0; i < roots.size(); ++i) markGray(roots[i]);
+            for (i = 0; i < roots.size(); ++i) scan(roots[i]);
+            for (i = 0; i < roots.size(); ++i) collectWhite(s, roots[i], garbage);
+
+            // Nothing outside the garbage refers to it any more. Clear the
+            // counts so destructors below do not drop references to entries
+            // that are being freed along with them. Each entry is unlinked
+            // first, or a sweep on another thread could free it as well.
+            for (i = 0; i < garbage.size(); ++i) {
+                garbage[i]->ops->unlink(garbage[i]);
+                garbage[i]->refcount = 0;
+            }
+        }
+
+        #ifdef DISPLAY
+        if (!garbage.empty()) {
+            cout << "Freeing " << garbage.size() << " objects in cycles\n";
+        }
+        #endif
+
+        GCHeap::release(garbage);
+
+        lock_guard<GCMutex> guard(s.mutex);
+        s.running = false;
+        s.lastFreed = garbage.size();
+        return garbage.size();
+    }
+
+    // Run collect() on the next slice of candidates once enough have
+    // built up. Collections started by a GCPolicy call this.
+    static size_t step() {
+
+        State &s = state();
+        size_t batch;
+
+        {
+            lock_guard<GCMutex> guard(s.mutex);
+            if (s.running || s.roots.size() < s.threshold) return 0;
+            batch = s.batch;
+        }
+        return collect(batch);
+    }
+
+    // step() runs once threshold candidates are waiting and
+    // then looks at no more than batch of them
+    static void setIncrement(size_t threshold, size_t batch) {
+
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+
+        s.threshold = threshold;
+        s.batch = batch ? batch : 1;
+    }
+
+    // Return the number of objects freed by the most recent pass
+    static size_t lastFreed() {
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+        return s.lastFreed;
+    }
+
+    // Return the number of candidate roots waiting for a pass
+    static size_t candidates() {
+        State &s = state();
+        lock_guard<GCMutex> guard(s.mutex);
+        return s.roots.size();
+    }
+
+private:
+
+    struct State {
+        vector<GCInfoBase *> roots; // candidate roots
+        GCMutex mutex; // guards this structure
+        bool running; // true while a pass is under way
+        size_t lastFreed; // objects freed by the last pass
+        size_t threshold; // candidates needed before step() runs
+        size_t batch; // candidates taken by step()
+        GCFlag buffering; // true while candidates are recorded
+
+        State() {
+            running = false;
+            #ifdef GC_THREAD_SAFE
+            buffering = false;
+            #else
+            buffering = true;
+            #endif
+            lastFreed = 0;
+            threshold = 256;
+            batch = 256;
+        }
+    };
+
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
+
+    // Remove p from the candidate roots. s.mutex must be held.
+    static void unbuffer(State &s, GCInfoBase *p) {
+
+        if (p->rootIndex == GCInfoBase::NOT_BUFFERED) return;
+
+        GCInfoBase *last = s.roots.back();
+        s.roots[p->rootIndex] = last;
+        last->rootIndex = p->rootIndex;
+        s.roots.pop_back();
+
+        p->rootIndex = GCInfoBase::NOT_BUFFERED;
+    }
+
+    // Collects the entries a gcTrace() call reports
+    class ChildList : public GCVisitor {
+    public:
+        vector<GCInfoBase *> items;
+    protected:
+        void visit(GCInfoBase *p) { items.push_back(p); }
+    };
+
+    // Fill kids with the entries p refers to
+    static void children(GCInfoBase *p, ChildList &kids) {
+        kids.items.clear();
+        p->ops->trace(p, kids);
+    }
+
+    // Colour root and everything reachable from it gray, subtracting
+    // each reference found from the copy of its target's count
+    static void markGray(GCInfoBase *root) {
+
+        vector<GCInfoBase *> stack;
+        ChildList kids;
+
+        if (root->color == GCInfoBase::GRAY) return;
+
+        root->color = GCInfoBase::GRAY;
+        root->crc = root->refcount;
+        stack.push_back(root);
+
+        while (!stack.empty()) {
+
+            GCInfoBase *p = stack.back();
+            stack.pop_back();
+
+            children(p, kids);
+            for (size_t i = 0; i < kids.items.size(); ++i) {
+
+                GCInfoBase *c = kids.items[i];
+
+                if (c->color != GCInfoBase::GRAY) {
+                    c->color = GCInfoBase::GRAY;
+                    c->crc = c->refcount;
+                    stack.push_back(c);
+                }
+                c->crc--;
+            }
+        }
+    }
+
+    // Colour gray entries that are still referenced from outside,
+    // and everything they reach, black. Colour the rest white.
+    static void scan(GCInfoBase *root) {
+
+        vector<GCInfoBase *> stack;
+        ChildList kids;
+
+        stack.push_back(root);
+
+        while (!stack.empty()) {
+
+            GCInfoBase *p = stack.back();
+            stack.pop_back();
+
+            if (p->color != GCInfoBase::GRAY) continue;
+
+            if (p->crc > 0) {
+                scanBlack(p);
+                continue;
+            }
+
+            p->color = GCInfoBase::WHITE;
+
+            children(p, kids);
+            stack.insert(stack.end(), kids.items.begin(), kids.items.end());
+        }
+    }
+
+    // Colour root and everything reachable from it black,
+    // putting back the references markGray() took away
+    static void scanBlack(GCInfoBase *root) {
+
+        vector<GCInfoBase *> stack;
+        ChildList kids;
+
+        root->color = GCInfoBase::BLACK;
+        stack.push_back(root);
+
+        while (!stack.empty()) {
+
+            GCInfoBase *p = stack.back();
+            stack.pop_back();
+
+            children(p, kids);
+            for (size_t i = 0; i < kids.items.size(); ++i) {
+
+                GCInfoBase *c = kids.items[i];
+
+                c->crc++;
+                if (c->color != GCInfoBase::BLACK) {
+                    c->color = GCInfoBase::BLACK;
+                    stack.push_back(c);
+                }
+            }
+        }
+    }
+
+    // Move the white entries reachable from root to garbage
+    static void collectWhite(State &s, GCInfoBase *root,
+                             vector<GCInfoBase *> &garbage) {
+
+        vector<GCInfoBase *> stack;
+        ChildList kids;
+
+        stack.push_back(root);
+
+        while (!stack.empty()) {
+
+            GCInfoBase *p = stack.back();
+            stack.pop_back();
+
+            if (p->color != GCInfoBase::WHITE) continue;
+
+            p->color = GCInfoBase::BLACK;
+            unbuffer(s, p);
+            garbage.push_back(p);
+
+            children(p, kids);
+            stack.insert(stack.end(), kids.items.begin(), kids.items.end());
+        }
+    }
+};
+
+// A link in the list of roots kept by the tracing collector
+class GCRootBase {
+
+public:
+    GCRootBase *prev;
+    GCRootBase *next;
+
+    virtual ~GCRootBase() {}
+
+    // Return the entry this root currently refers to, or NULL
+    virtual GCInfoBase *rootInfo() const = 0;
+};
+
+// GCMarkSweep is the collector used in tracing mode. It marks every
+// entry reachable from the registered roots, then has each GCPtr type
+// in GCHeap unlink its unmarked entries, and frees those together.
+//
+// It is generational. A minor collection marks only young entries,
+// starting from the roots and from the remembered set, and sweeps only
+// the young part of each gclist. The write barrier in GCPtr adds a young
+// entry to the remembered set when it is stored anywhere other than a
+// root or an object make_gc() made since the last collection, which is
+// how references from old objects to young ones are found. Entries that
+// survive TENURE collections are promoted and are freed only by a full
+// collection.
+class GCMarkSweep {
+
+public:
+
+    // Add r to the roots
+    static void addRoot(GCRootBase *r) {
+
+        State &s = state();
+
+        r->prev = NULL;
+        r->next = s.roots;
+        if (s.roots) s.roots->prev = r;
+        s.roots = r;
+    }
+
+    // Remove r from the roots
+    static void removeRoot(GCRootBase *r) {
+
+        State &s = state();
+
+        if (r->prev) r->prev->next = r->next;
+        else s.roots = r->next;
+        if (r->next) r->next->prev = r->prev;
+    }
+
+    // Held by make_gc() while it constructs an object. The object is
+    // not in any gclist yet, so anything it allocates is reachable only
+    // through it and collection must wait until it is finished.
+    class Construction {
+    public:
+        Construction() { state().constructing++; }
+        ~Construction() { state().constructing--; }
+    };
+
+    // Return true if a collection may start now
+    static bool canCollect() {
+        State &s = state();
+        return !s.running && s.constructing == 0;
+    }
+
+    // The write barrier. Record that p was stored in the GCPtr at slot.
+    static void remember(GCInfoBase *p, const void *slot) {
+
+        if (p->isOld() || p->remembered) return;
+
+        // An object allocated since the last collection is marked through
+        // whenever it is reachable, and is no older than anything it
+        // refers to, so a GCPtr inside one need not be remembered.
+        // Such an object made by make_gc() begins with its entry.
+        GCInfoBase *owner = (GCInfoBase *) GCPool::blockOf(slot);
+        if (owner && owner->age == 0) return;
+
+        p->remembered = true;
+        state().remembered.push_back(p);
+    }
+
+    // Note n bytes of newly managed memory
+    static void allocated(size_t n) {
+        state().youngBytes += n;
+    }
+
+    // Run a minor collection once this many bytes have been
+    // allocated since the last collection
+    static void setNursery(size_t bytes) {
+        state().nurseryBytes = bytes;
+    }
+
+    // Run a minor collection if the nursery is full
+    static size_t collectYoungIfFull() {
+        State &s = state();
+        if (s.youngBytes < s.nurseryBytes) return 0;
+        return collectYoung();
+    }
+
+    // Mark from the roots, sweep every GCPtr type and free what is
+    // unreachable. Return the number of objects freed.
+    static size_t collect() {
+        return run(false);
+    }
+
+    // Mark from the roots and the remembered set, sweep the young part
+    // of every GCPtr type and free what is unreachable. Return the
+    // number of objects freed.
+    static size_t collectYoung() {
+        return run(true);
+    }
+
+    // Return the number of objects freed by the most recent collection
+    static size_t lastFreed() {
+        return state().lastFreed;
+    }
+
+private:
+
+    struct State {
+        GCRootBase *roots; // first root, NULL if there are none
+        vector<GCInfoBase *> remembered; // young entries stored outside the young objects
+        unsigned constructing; // make_gc() calls under way
+        bool running; // true while a collection is under way
+        size_t lastFreed; // objects freed by the last collection
+        size_t youngBytes; // memory allocated since the last collection
+        size_t nurseryBytes; // youngBytes that start a minor collection
+
+        State() {
+            roots = NULL;
+            constructing = 0;
+            running = false;
+            lastFreed = 0;
+            youngBytes = 0;
+            nurseryBytes = 1024 * 1024;
+        }
+    };
+
+    static State &state() {
+        return GCSingleton<State>::get();
+    }
+
+    // Run a full or a minor collection
+    static size_t run(bool young) {
+
+        State &s = state();
+        vector<GCInfoBase *> garbage;
+        size_t i;
+
+        if (!canCollect()) return 0;
+        s.running = true;
+
+        GCMetrics::Pause pause;
+
+        // Mark everything reachable from a root. A minor collection
+        // also marks from the remembered set and stops at old entries.
+        Marker marker(young);
+        for (GCRootBase *r = s.roots; r; r = r->next) {
+            marker.mark(r->rootInfo());
+        }
+        if (young) {
+            for (i = 0; i < s.remembered.size(); ++i) marker.mark(s.remembered[i]);
+        }
+        marker.drain();
+
+        // Every survivor of a full collection is promoted, so
+        // the remembered set is emptied while its entries are valid
+        if (!young) {
+            for (i = 0; i < s.remembered.size(); ++i) s.remembered[i]->remembered = false;
+            s.remembered.clear();
+        }
+
+        GCHeap::unlinkAll(garbage, young ? GCHeap::YOUNG_UNMARKED : GCHeap::UNMARKED);
+
+        // Remembered entries survive a minor collection.
+        // Those it promoted leave the remembered set.
+        size_t kept = 0;
+        for (i = 0; i < s.remembered.size(); ++i) {
+            GCInfoBase *p = s.remembered[i];
+            if (!p->isOld()) s.remembered[kept++] = p;
+            else p->remembered = false;
+        }
+        s.remembered.resize(kept);
+
+        #ifdef DISPLAY
+        cout << (young ? "Minor" : "Mark-sweep") << " collection freeing "
+        << garbage.size() << " objects\n";
+        #endif
+
+        GCHeap::release(garbage);
+
+        s.youngBytes = 0;
+        s.running = false;
+        s.lastFreed = garbage.size();
+        return garbage.size();
+    }
+
+    // Marks entries and the entries they refer to, using an explicit stack
+    class Marker : public GCVisitor {
+    public:
+        // A marker for a minor collection leaves old entries alone
+        explicit Marker(bool y) : young(y) {}
+
+        void mark(GCInfoBase *p) {
+            if (!p || p->marked || (young && p->isOld())) return;
+            p->marked = true;
+            stack.push_back(p);
+        }
+
+        void drain() {
+            while (!stack.empty()) {
+                GCInfoBase *p = stack.back();
+                stack.pop_back();
+                p->ops->trace(p, *this);
+            }
+        }
+
+    protected:
+        void visit(GCInfoBase *p) { mark(p); }
+
+    private:
+        bool young;
+        vector<GCInfoBase *> stack;
+    };
+};
+
+// GCInfo implements a pointer type that uses garbage collection to release unused memory.
+// A GCPtr must only be used to point to memory that was dynamically allocated using new.
+// When used to refer to an allocated array, give the array length to the constructor
+// or create the array with make_gc_array(). Every GCPtr<T> shares this class's
+// gclist, so there is one list per type whatever the lengths of its arrays.
+template <class T> class GCPtr<T, 0> {
+
+        // gclist maintains the garbage collection list.
+        static GCList<T> gclist;
+
+        // gcindex maps each address in gclist to its entry so that
+        // findPtrInfo does not have to scan the list
+        static GCIndex<T *, GCInfo<T> *> gcindex;
+
+        // info points to the entry in gclist for the memory this GCPtr
+        // points to. Copies and assignments between GCPtrs update it
+        // directly, without a search. It is the only member, so a GCPtr
+        // is the size of a pointer: the address of the memory, whether
+        // it is an array and its length are all read from the entry.
+        GCInfo<T> *info;
+
+        // Return the memory this GCPtr points to
+        T *get() const {
+            return info ? info->memPtr : NULL;
+        }
+
+        // Return the number of objects this GCPtr points to
+        unsigned length() const {
+            if (!info || !info->memPtr) return 0;
+            return info->isArray ? info->arraySize : 1;
+        }
+
+        static bool first; // true until this type is added to GCHeap
+
+        // gcmutex guards gclist, gcindex and first
+        static GCMutex gcmutex;
+
+        // sweepmutex is held for the whole of a sweep, and by anything
+        // else that removes entries from gclist. So a sweep can let go of
+        // gcmutex every SWEEP_BATCH entries, keeping its place, and other
+        // threads are never held up by a whole scan.
+        static GCMutex sweepmutex;
+        static const size_t SWEEP_BATCH = 256;
+
+        // The entry collect_for() resumes at, or NULL to start
+        // from the front. Guarded by gcmutex.
+        static GCInfo<T> *cursor;
+
+        // Bookkeeping used by the collection policy
+        static GCCounter liveBytes; // managed memory referenced from gclist
+        static GCCounter lastLiveBytes; // liveBytes after the last collection
+        static GCCounter pendingEntries; // entries unreferenced since the last collection
+        static GCCounter pendingBytes; // memory of those entries
+        static GCCounter pendingOldEntries; // the part of pendingEntries that is old
+        static GCCounter pendingOldBytes; // memory of those entries
+
+        // The policy for this type of GCPtr, if it has its own
+        static GCPolicy::Shared policy;
+
+        // The next three functions must be called with gcmutex held
+
+        // Return the entry in gclist for ptr, or NULL if there is none
+        static GCInfo<T> *findPtrInfo(T *ptr);
+
+        // Add a new entry for t to gclist. t is an array of n
+        // objects allocated with new[], or a single object if n is 0.
+        static GCInfo<T> *addPtrInfo(T *t, unsigned n);
+
+        // Add the newly created entry p to gclist
+        static GCInfo<T> *registerPtrInfo(GCInfo<T> *p);
+
+        // Return the entry for t with its reference count incremented,
+        // adding a new entry for an array of n if t is not in gclist.
+        // added is set to true if a new entry was made.
+        static GCInfo<T> *acquirePtrInfo(T *t, bool &added, unsigned n = 0);
+
+        // Drop one reference to the entry p, if there is one. Return
+        // true if this left garbage or a candidate for the cycle collector.
+        static bool releasePtrInfo(GCInfo<T> *p);
+
+        // The operations the collectors use on entries in gclist
+        static const GCInfoOps gcops;
+
+        // The record of this type kept by GCHeap
+        static const GCHeap::Space gcspace;
+
+        // Remove p from gclist for the cycle collector
+        static void unlinkPtrInfo(GCInfoBase *p);
+
+        // Return the name of T, for GCStats
+        static const char *typeName() {
+            return typeid(T).name();
+        }
+
+        // Remove p from gclist and gcindex, moving the cursor past
+        // it. Must be called with sweepmutex and gcmutex held.
+        static void erasePtrInfo(GCInfo<T> *p);
+
+        // Release p once its object is destroyed, or leave it to the
+        // last GCWeakPtr that refers to it
+        static void freePtrInfo(GCInfoBase *p);
+
+        // Return p with its reference count incremented if it has the
+        // given generation, that is if its object still exists, or NULL
+        static GCInfo<T> *lockWeak(GCInfo<T> *p, unsigned generation);
+
+        // Drop one GCWeakPtr reference to p
+        static void releaseWeak(GCInfo<T> *p);
+
+        // Move up to n unreferenced entries from the cursor onwards to
+        // garbage. Return true if the end of gclist was reached.
+        static bool unlinkSlice(vector<GCInfoBase *> &garbage, size_t n);
+
+        // Free the unreferenced entries in gclist, or only the young
+        // ones if young is true. Return true if at least one object was freed.
+        static bool sweep(bool young = false);
+
+        // Sweep if any entry has become unreferenced since the last
+        // sweep, only the young entries unless at least half the
+        // garbage is old. Return true if at least one object was freed.
+        static bool sweepPending();
+
+        // Under IMMEDIATE, old garbage is left for a full sweep
+        // until it is at least 1/OLD_SHARE of gclist
+        static const size_t OLD_SHARE = 8;
+
+        // Move the entries selected by which from gclist to garbage.
+        // Return the number of entries moved.
+        static size_t unlinkEntries(vector<GCInfoBase *> &garbage,
+                                    GCHeap::Which which);
+
+        // In tracing mode, collect if the policy asks for it
+        static void collectBeforeAdding();
+
+        // Collect garbage if the collection policy asks for it
+        static void maybeCollect();
+
+        // In tracing mode, tell the collector what was stored in this GCPtr
+        void writeBarrier() {
+            #ifdef GC_TRACING
+            if (info) GCMarkSweep::remember(info, this);
+            #endif
+        }
+
+        // Selects the constructors that skip the write barrier. Roots
+        // use them, since the collector marks from every root.
+        struct NoBarrier {};
+
+        GCPtr(T *t, unsigned n, NoBarrier);
+        GCPtr(const GCPtr &ob, NoBarrier);
+
+        GCPtr(T *t, NoBarrier nb) : GCPtr(t, 0, nb) {}
+
+        // Selects the constructor that takes over a reference
+        // already counted in the entry
+        struct Counted {};
+
+        GCPtr(GCInfo<T> *p, Counted) : info(p) {
+            writeBarrier();
+        }
+
+        // Assignments without the write barrier
+        void assign(T *t, unsigned n = 0);
+        void assign(const GCPtr &rv);
+
+        // Selects the constructor that adds a new entry to gclist,
+        // so a null pointer constant only matches GCPtr(T *)
+        struct NewEntry {};
+
+        // Construct a GCPtr that takes over the reference held by
+        // p, an entry made by make_gc() that is not yet in gclist
+        GCPtr(GCInfo<T> *p, NewEntry) {
+            {
+                lock_guard<GCMutex> guard(gcmutex);
+                info = registerPtrInfo(p);
+            }
+
+            GC_TRACE(CONSTRUCT, info, info->refcount);
+
+            #ifndef GC_TRACING
+            maybeCollect();
+            #endif
+        }
+
+        template <class U, class... Args> friend GCPtr<U> make_gc(Args &&... args);
+        template <class U> friend GCPtr<U> make_gc_array(unsigned n);
+
+        // The fixed-length GCPtrs below build on this one
+        template <class U, int s> friend class GCPtr;
+
+        template <class U> friend class GCWeakPtr;
+
+        friend class GCVisitor;
+
+        #ifdef GC_TRACING
+        template <class U, int s> friend class GCRoot;
+        #endif
+
+public:
+    // Define an iterator type for GCPtr<T>
+    typedef Iter<T> GCIterator;
+    typedef Iter<const T> GCConstIterator;
+
+    // Construct both initialized and uninitialized objects
+    GCPtr(T *t=NULL) : GCPtr(t, 0, NoBarrier()) {
+        writeBarrier();
+    }
+
+    // Construct a GCPtr to an array of n objects allocated with new[],
+    // so that it is freed with delete[]. n must not be 0.
+    GCPtr(T *t, unsigned n) : GCPtr(t, n, NoBarrier()) {
+        writeBarrier();
+    }
+
+    // Copy constructor
+    GCPtr(const GCPtr &ob) : GCPtr(ob, NoBarrier()) {
+        writeBarrier();
+    }
+
+    // Move constructor. Takes over the reference held by ob and leaves
+    // ob null, so neither the reference count nor gclist is touched.
+    GCPtr(GCPtr &&ob) noexcept {
+
+        info = ob.info;
+        ob.info = NULL;
+
+        writeBarrier();
+    }
+
+    // Destructor for GCPtr
+    ~GCPtr();
+
+    // Collect garbage, including garbage cycles outside thread-safe
+    // mode. Returns true if at least one object was freed.
+    static bool collect();
+
+    // Collect garbage for about budget, resuming where the last call
+    // stopped, so a long gclist can be swept a slice at a time. A call
+    // stops early once it reaches the end of gclist. Returns true if
+    // at least one object was freed. In tracing mode marking cannot be
+    // split up, so this runs a minor collection instead.
+    static bool collect_for(chrono::microseconds budget);
+
+    // Choose when this type of GCPtr collects garbage on its own
+    static void setPolicy(const GCPolicy &p) {
+        policy.store(p);
+    }
+
+    // Go back to following GCPolicy::global()
+    static void useGlobalPolicy() {
+        policy.clear();
+    }
+
+    // Return the policy currently in effect for this type of GCPtr
+    static GCPolicy currentPolicy() {
+
+        GCPolicy p;
+
+        if (policy.load(p)) return p;
+        return GCPolicy::global();
+    }
+
+    // overload assignment of pointer to GCPtr
+    T *operator=(T *t) {
+        assign(t);
+        writeBarrier();
+        return t;
+    }
+
+    // Overload asssignment of GCPtr to GCPtr
+    GCPtr &operator=(const GCPtr &rv) {
+        assign(rv);
+        writeBarrier();
+        return *this;
+    }
+
+    // Overload move assignment of GCPtr to GCPtr
+    GCPtr &operator=(GCPtr &&rv) noexcept;
+
+    // Return reference to the object pointed to by this GCPtr
+    T &operator*() {
+        return *get();
+    }
+
+    // Return address being pointer to
+    T *operator->() {
+        return get();
+    }
+
+    // Return a reference to the object at the index specified by i
+    T &operator[](int i) {
+        return get()[i];
+    }
+
+    // Conversion to T *
+    operator T *() {
+        return get();
+    }
+
+    // Return an Iter to the start of the allocated memory. Bounds
+    // chooses whether the Iter checks each access.
+    template <class Bounds = GCBoundsChecked>
+    Iter<T, Bounds> begin() {
+
+        T *addr = get();
+        unsigned sz = length();
+
+        return Iter<T, Bounds>(addr, addr, addr + sz);
+    }
+
+    // Return an Iter to one past the end of an allocated array
+    template <class Bounds = GCBoundsChecked>
+    Iter<T, Bounds> end() {
+
+        T *addr = get();
+        unsigned sz = length();
+
+        return Iter<T, Bounds>(addr + sz, addr, addr + sz);
+    }
+
+    // The same over const objects
+    template <class Bounds = GCBoundsChecked>
+    Iter<const T, Bounds> begin() const {
+
+        const T *addr = get();
+        unsigned sz = length();
+
+        return Iter<const T, Bounds>(addr, addr, addr + sz);
+    }
+
+    template <class Bounds = GCBoundsChecked>
+    Iter<const T, Bounds> end() const {
+
+        const T *addr = get();
+        unsigned sz = length();
+
+        return Iter<const T, Bounds>(addr + sz, addr, addr + sz);
+    }
+
+    template <class Bounds = GCBoundsChecked>
+    Iter<const T, Bounds> cbegin() const {
+        return begin<Bounds>();
+    }
+
+    template <class Bounds = GCBoundsChecked>
+    Iter<const T, Bounds> cend() const {
+        return end<Bounds>();
+    }
+
+    // Return the whole array as a GCSpan
+    GCSpan<T> span() {
+        T *addr = get();
+        return GCSpan<T>(addr, addr + length());
+    }
+
+    // Return count objects from start as a GCSpan. The range is checked
+    // here, once, and throws OutOfRangeExc if it is not in the array.
+    GCSpan<T> span(unsigned start, unsigned count) {
+
+        T *addr = get();
+        unsigned sz = length();
+
+        if (start > sz || count > sz - start) throw OutOfRangeExc();
+        return GCSpan<T>(addr + start, addr + start + count);
+    }
+
+    // Return the size of gclist for this type of GCPtr
+    static int gclistSize() {
+        lock_guard<GCMutex> guard(gcmutex);
+        return gclist.size();
+    }
+
+    // Return the managed memory referenced from gclist
+    static size_t managedBytes() {
+        return liveBytes;
+    }
+
+    // A utility function that displays gclist
+    static void showlist();
+
+    // Free every object in gclist. GCHeap::shutdown() frees
+    // the objects of all types when the program exits.
+    static void shutdown();
+
+    };
+
+    // A GCPtr holds nothing but a pointer to its entry
+    static_assert(sizeof(GCPtr<int>) == sizeof(void *),
+                  "GCPtr must be the size of a pointer");
+
+    // GCPtr<T, size> is a GCPtr<T> for arrays allocated with new T[size].
+    // It differs only in giving new memory the length size, so it shares
+    // the gclist and code of GCPtr<T> and converts to and from it. To
+    // choose the length at run time use make_gc_array() or GCPtr<T>(t, n).
+    template <class T, int size>
+    class GCPtr : public GCPtr<T> {
+
+    public:
+        GCPtr(T *t = NULL) : GCPtr<T>(t, size) {}
+
+        GCPtr(const GCPtr<T> &ob) : GCPtr<T>(ob) {}
+
+        T *operator=(T *t) {
+            assign(t);
+            this->writeBarrier();
+            return t;
+        }
+
+        GCPtr &operator=(const GCPtr<T> &rv) {
+            GCPtr<T>::operator=(rv);
+            return *this;
+        }
+
+    protected:
+        // For GCRoot, as in GCPtr<T>
+        typedef typename GCPtr<T>::NoBarrier NoBarrier;
+
+        GCPtr(T *t, NoBarrier nb) : GCPtr<T>(t, size, nb) {}
+        GCPtr(const GCPtr<T> &ob, NoBarrier nb) : GCPtr<T>(ob, nb) {}
+
+        using GCPtr<T>::assign;
+
+        void assign(T *t) {
+            GCPtr<T>::assign(t, size);
+        }
+    };
+
+    // Create a storage for the static variables
+    template <class T>
+    GCList<T> GCPtr<T>::gclist;
+
+    template <class T>
+    GCIndex<T *, GCInfo<T> *> GCPtr<T>::gcindex;
+
+    template <class T>
+    bool GCPtr<T>::first = true;
+
+    template <class T>
+    GCMutex GCPtr<T>::gcmutex;
+
+    template <class T>
+    GCMutex GCPtr<T>::sweepmutex;
+
+    template <class T>
+    const size_t GCPtr<T>::SWEEP_BATCH;
+
+    template <class T>
+    GCInfo<T> *GCPtr<T>::cursor = NULL;
+
+    template <class T>
+    GCCounter GCPtr<T>::liveBytes(0);
+
+    template <class T>
+    GCCounter GCPtr<T>::lastLiveBytes(0);
+
+    template <class T>
+    GCCounter GCPtr<T>::pendingEntries(0);
+
+    template <class T>
+    GCCounter GCPtr<T>::pendingBytes(0);
+
+    template <class T>
+    GCCounter GCPtr<T>::pendingOldEntries(0);
+
+    template <class T>
+    GCCounter GCPtr<T>::pendingOldBytes(0);
+
+    template <class T>
+    GCPolicy::Shared GCPtr<T>::policy;
+
+    template <class T>
+    const GCInfoOps GCPtr<T>::gcops = {
+        &GCInfo<T>::trace,
+        &GCPtr<T>::unlinkPtrInfo,
+        &GCInfo<T>::destroyObject,
+        &GCPtr<T>::freePtrInfo,
+        &GCInfo<T>::show
+    };
+
+    template <class T>
+    const GCHeap::Space GCPtr<T>::gcspace = {
+        &GCPtr<T>::unlinkEntries,
+        &GCPtr<T>::gclistSize,
+        &GCPtr<T>::managedBytes,
+        &GCPtr<T>::sweepPending,
+        &GCPtr<T>::typeName
+    };
+
+    // Construct a GCPtr to t without the write barrier
+    template <class T>
+    GCPtr<T>::GCPtr(T *t, unsigned n, NoBarrier) {
+
+        bool added;
+
+        // if t is already in gclist, then increment its reference count.
+        // Otherwise, add it to the list
+        info = acquirePtrInfo(t, added, n);
+        if (added) maybeCollect();
+
+        GC_TRACE(CONSTRUCT, info, info ? (size_t) info->refcount : 0);
+
+        #ifdef DISPLAY
+        cout << "Constructing GCPtr. ";
+        if (info && info->isArray) {
+            cout << "size is : " << info->arraySize << endl;
+        } else {
+            cout << endl;
+        }
+
+        #endif
+    }
+
+    // Copy ob without the write barrier
+    template <class T>
+    GCPtr<T>::GCPtr(const GCPtr &ob, NoBarrier) {
+
+        info = ob.info;
+
+        #ifndef GC_TRACING
+        if (info) {
+            info->refcount++; // increment ref count
+            GCMetrics::increment();
+        }
+        #endif
+
+        GC_TRACE(COPY, info, info ? (size_t) info->refcount : 0);
+
+        #ifdef DISPLAY
+            cout << "Constructing copy";
+            if (info && info->isArray) {
+                cout << "Size is " << info->arraySize << endl;
+            } else {
+                cout << endl;
+            }
+        #endif
+    }
+
+    // Destructor for GCPtr
+    template <class T>
+    GCPtr<T>::~GCPtr() {
+
+        // A moved-from GCPtr holds no reference. In tracing
+        // mode no GCPtr holds one.
+        #ifndef GC_TRACING
+        if (!info) return;
+
+        GC_TRACE(DESTRUCT, info, info->refcount);
+
+        // decrement ref count
+        bool changed = info->refcount && releasePtrInfo(info);
+
+        #ifdef DISPLAY
+            cout << "GCPtr pointer out of scope.\n";
+        #endif
+
+        // Collect garbage if the policy for this type asks for it. Nothing
+        // the policy looks at has changed unless the release left work.
+        if (changed) maybeCollect();
+        #endif
+    }
+
+    // Add a new entry for t to gclist
+    template <class T>
+    GCInfo<T> *GCPtr<T>::addPtrInfo(T *t, unsigned n) {
+        return registerPtrInfo(new GCInfo<T>(t, n));
+    }
+
+    // Add the newly created entry p to gclist
+    template <class T>
+    GCInfo<T> *GCPtr<T>::registerPtrInfo(GCInfo<T> *p) {
+
+        // Let GCHeap collect and shut down this type
+        if (first) GCHeap::addSpace(&gcspace);
+        first = false;
+
+        p->ops = &gcops;
+        gclist.push_front(p);
+        gcindex.insert(p->memPtr, p);
+
+        liveBytes += p->bytes();
+
+        #ifdef GC_TRACING
+        // Allocations since the last collection drive the policy
+        pendingEntries++;
+        pendingBytes += p->bytes();
+        GCMarkSweep::allocated(p->bytes());
+        #endif
+
+        return p;
+    }
+
+    // In tracing mode, run a full collection if the policy asks for it,
+    // or a minor one if the nursery is full. Called before a new entry
+    // is added, so the entry cannot be freed.
+    template <class T>
+    void GCPtr<T>::collectBeforeAdding() {
+
+        if (!GCMarkSweep::canCollect()) return;
+
+        if (currentPolicy().shouldCollect(pendingEntries, pendingBytes,
+                                          liveBytes, lastLiveBytes)) {
+            GCMarkSweep::collect();
+        } else {
+            GCMarkSweep::collectYoungIfFull();
+        }
+    }
+
+    // Return the entry for t with its reference count incremented
+    template <class T>
+    GCInfo<T> *GCPtr<T>::acquirePtrInfo(T *t, bool &added, unsigned n) {
+
+        lock_guard<GCMutex> guard(gcmutex);
+
+        #ifdef GC_TRACING
+        // Null GCPtrs have no entry, since a null entry that no root
+        // reaches would be freed while GCPtrs still refer to it
+        added = false;
+        if (!t) return NULL;
+        #endif
+
+        GCInfo<T> *p = findPtrInfo(t);
+
+        added = p == NULL;
+        if (p) {
+            #ifndef GC_TRACING
+            p->refcount++; // increment ref count
+            GCMetrics::increment();
+            #endif
+        } else {
+            #ifdef GC_TRACING
+            // Collect while nothing refers to t, so it cannot be freed
+            collectBeforeAdding();
+            #endif
+
+            // Create and store this entry
+            p = addPtrInfo(t, n);
+        }
+        return p;
+    }
+
+    // Drop one reference to the entry p and note when it becomes garbage
+    template <class T>
+    bool GCPtr<T>::releasePtrInfo(GCInfo<T> *p) {
+
+        #ifdef GC_TRACING
+        // Nothing is counted in tracing mode
+        (void) p;
+        return false;
+        #else
+        if (!p) return false;
+
+        GCMetrics::decrement();
+
+        // Once the count reaches zero another thread may free p,
+        // so read what is needed while the reference is still held
+        size_t bytes = p->bytes();
+        bool old = p->isOld();
+
+        // If other references remain, p may be part of a garbage cycle.
+        // Buffering it before the decrement means it is still alive.
+        bool buffered = GCTraceable<T>::value && p->refcount > 1 &&
+                        GCCycleCollector::buffering();
+        if (buffered) GCCycleCollector::addRoot(p);
+
+        if (--p->refcount == 0) {
+            pendingEntries++;
+            pendingBytes += bytes;
+
+            // Only a full sweep finds old garbage
+            if (old) {
+                pendingOldEntries++;
+                pendingOldBytes += bytes;
+            }
+            return true;
+        }
+        return buffered;
+        #endif
+    }
+
+    // Remove p from gclist. Used by the cycle collector.
+    template <class T>
+    void GCPtr<T>::unlinkPtrInfo(GCInfoBase *b) {
+
+        GCInfo<T> *p = static_cast<GCInfo<T> *>(b);
+
+        // Wait for any sweep between batches, which may be holding p
+        lock_guard<GCMutex> sweeping(sweepmutex);
+        lock_guard<GCMutex> guard(gcmutex);
+
+        erasePtrInfo(p);
+    }
+
+    // Remove p from gclist and gcindex
+    template <class T>
+    void GCPtr<T>::erasePtrInfo(GCInfo<T> *p) {
+
+        if (cursor == p) cursor = p->next;
+
+        size_t bytes = p->bytes();
+
+        gcindex.erase(p->memPtr);
+        gclist.erase(p);
+        liveBytes -= bytes;
+
+        // GCWeakPtrs to p no longer match it
+        p->generation++;
+
+        GCMetrics::freed(bytes);
+    }
+
+    // Release p, or leave it to the last GCWeakPtr to p. Called after
+    // p is unlinked, so no new GCWeakPtr to it can be made.
+    template <class T>
+    void GCPtr<T>::freePtrInfo(GCInfoBase *b) {
+
+        GCInfo<T> *p = static_cast<GCInfo<T> *>(b);
+        bool orphan;
+
+        // Decided under gcmutex, like the decrement in releaseWeak(),
+        // so only one of the two frees p and the other is done with it
+        {
+            lock_guard<GCMutex> guard(gcmutex);
+
+            orphan = p->weakcount > 0;
+            if (orphan) p->orphaned = true;
+        }
+
+        if (!orphan) GCInfo<T>::freeEntry(p);
+    }
+
+    // Return p with its reference count incremented, if its object exists
+    template <class T>
+    GCInfo<T> *GCPtr<T>::lockWeak(GCInfo<T> *p, unsigned generation) {
+
+        lock_guard<GCMutex> guard(gcmutex);
+
+        // A sweep unlinks entries with gcmutex held, so p cannot be
+        // removed between this check and the increment
+        if (p->generation != generation) return NULL;
+
+        #ifndef GC_TRACING
+        p->refcount++;
+        GCMetrics::increment();
+        #endif
+
+        return p;
+    }
+
+    // Drop one GCWeakPtr reference to p, releasing p if it was the last
+    // thing keeping p and its object is already destroyed
+    template <class T>
+    void GCPtr<T>::releaseWeak(GCInfo<T> *p) {
+
+        bool last;
+
+        {
+            lock_guard<GCMutex> guard(gcmutex);
+            last = --p->weakcount == 0 && p->orphaned;
+        }
+
+        if (last) GCInfo<T>::freeEntry(p);
+    }
+
+    // Collect garbage if the collection policy asks for it
+    template <class T>
+    void GCPtr<T>::maybeCollect() {
+
+        #ifdef GC_TRACING
+        // Collection happens in acquirePtrInfo(), before an entry is added
+        #else
+        if (currentPolicy().shouldCollect(pendingEntries, pendingBytes,
+                                          liveBytes, lastLiveBytes)) {
+            #ifdef GC_THREAD_SAFE
+            // Leave the sweep to the background collector if it is
+            // running, unless the heap limit has been reached
+            if (GCBackground::active() && !GCBackground::overLimit()) {
+                GCBackground::wake();
+                return;
+            }
+            #endif
+            sweepPending();
+        }
+
+        #ifndef GC_THREAD_SAFE
+        // Reclaim a slice of any garbage cycles that have built up
+        GCCycleCollector::step();
+        #endif
+        #endif
+    }
+
+    // Collect garbage. Return true if at least one object was freed
+    template <class T>
+    bool GCPtr<T>::collect() {
+
+        #ifdef GC_TRACING
+        // Tracing collects every type at once
+        return GCMarkSweep::collect() > 0;
+        #else
+        // The sweeps and the cycle passes make up one collection
+        GCMetrics::Pause pause;
+
+        bool memFreed = false;
+        bool freed;
+
+        // The destructors of freed objects may drop the last references
+        // to others, so repeat until a pass leaves no new garbage
+        do {
+            freed = sweep(false);
+
+            #ifndef GC_THREAD_SAFE
+            // Cycles are only reclaimed by trial deletion
+            if (GCCycleCollector::collect() > 0) freed = true;
+            #endif
+
+            if (freed) memFreed = true;
+        } while (freed && pendingEntries > 0);
+
+        return memFreed;
+        #endif
+    }
+
+    // Collect garbage for about budget. Return true if at least one object was freed.
+    template <class T>
+    bool GCPtr<T>::collect_for(chrono::microseconds budget) {
+
+        #ifdef GC_TRACING
+        (void) budget;
+        return GCMarkSweep::collectYoung() > 0;
+        #else
+        GCMetrics::Pause pause;
+
+        // The clock is read once per slice of this many entries
+        const size_t SLICE = 64;
+
+        chrono::steady_clock::time_point deadline =
+                chrono::steady_clock::now() + budget;
+        vector<GCInfoBase *> garbage;
+        bool memFreed = false;
+        bool done;
+
+        // Objects are freed after each slice, so
+        // their destructors count against the budget
+        do {
+            done = unlinkSlice(garbage, SLICE);
+            GCHeap::release(garbage);
+
+            if (!garbage.empty()) memFreed = true;
+            garbage.clear();
+        } while (!done && chrono::steady_clock::now() < deadline);
+
+        #ifndef GC_THREAD_SAFE
+        // Spend what is left on a slice of the cycle collector
+        if (chrono::steady_clock::now() < deadline) {
+            if (GCCycleCollector::step() > 0) memFreed = true;
+        }
+        #endif
+
+        return memFreed;
+        #endif
+    }
+
+    // Move up to n unreferenced entries from the cursor onwards to garbage
+    template <class T>
+    bool GCPtr<T>::unlinkSlice(vector<GCInfoBase *> &garbage, size_t n) {
+
+        size_t before = garbage.size();
+        bool done;
+
+        {
+            lock_guard<GCMutex> sweeping(sweepmutex);
+            lock_guard<GCMutex> guard(gcmutex);
+
+            GCInfo<T> *p = cursor ? cursor : gclist.front();
+
+            // Ages are left alone, since promoting from the
+            // middle of gclist would mix young and old entries
+            for (; p && n > 0; --n) {
+
+                GCInfo<T> *next = p->next;
+
+                if (p->refcount == 0) {
+
+                    // Take the entry off the pending counts it is in
+                    size_t bytes = p->bytes();
+                    if (pendingEntries > 0) pendingEntries--;
+                    pendingBytes -= bytes < pendingBytes ? bytes : (size_t) pendingBytes;
+                    if (p->isOld()) {
+                        if (pendingOldEntries > 0) pendingOldEntries--;
+                        pendingOldBytes -= bytes < pendingOldBytes ? bytes : (size_t) pendingOldBytes;
+                    }
+
+                    erasePtrInfo(p);
+                    garbage.push_back(p);
+                }
+                p = next;
+            }
+
+            cursor = p;
+            done = p == NULL;
+            if (done) lastLiveBytes = (size_t) liveBytes;
+        }
+
+        // The cycle collector must not keep entries that are about to be freed
+        if (GCTraceable<T>::value) {
+            for (size_t i = before; i < garbage.size(); ++i) {
+                GCCycleCollector::removeRoot(garbage[i]);
+            }
+        }
+        return done;
+    }
+
+    // Free the unreferenced entries, or only the young ones.
+    // Return true if at least one object was freed.
+    template <class T>
+    bool GCPtr<T>::sweep(bool young) {
+
+        GCMetrics::Pause pause;
+
+        // Unreferenced entries are collected here and their memory is
+        // released afterwards. Deleting an object can run a destructor
+        // that touches gclist, so nothing is freed mid-scan.
+        vector<GCInfoBase *> garbage;
+
+        #ifdef DISPLAY
+            cout << "Before garbage collection for ";
+            showlist();
+        #endif
+
+        unlinkEntries(garbage, young ? GCHeap::YOUNG_UNREFERENCED
+                                     : GCHeap::UNREFERENCED);
+        GCHeap::release(garbage);
+
+        #ifdef DISPLAY
+            cout << "After garbage collection for ";
+            showlist();
+        #endif
+
+        return !garbage.empty();
+    }
+
+    template <class T>
+    bool GCPtr<T>::sweepPending() {
+
+        size_t entries = pendingEntries;
+        size_t old = pendingOldEntries;
+
+        if (entries == 0) return false;
+
+        // A full sweep for each old entry released would make
+        // every release as slow as a scan of gclist
+        if (currentPolicy().kind == GCPolicy::IMMEDIATE) {
+            size_t size;
+            {
+                lock_guard<GCMutex> guard(gcmutex);
+                size = gclist.size();
+            }
+            if (old * OLD_SHARE < size) return entries > old && sweep(true);
+        }
+
+        return sweep(old * 2 < entries);
+    }
+
+    // Move the entries selected by which from gclist to garbage
+    template <class T>
+    size_t GCPtr<T>::unlinkEntries(vector<GCInfoBase *> &garbage,
+                                         GCHeap::Which which) {
+
+        size_t before = garbage.size();
+        size_t kept = 0; // young survivors so far
+        size_t youngLimit = GCHeap::youngLimit();
+        GCInfo<T> *p, *next;
+
+        bool young = which == GCHeap::YOUNG_UNREFERENCED ||
+                     which == GCHeap::YOUNG_UNMARKED;
+
+        {
+            lock_guard<GCMutex> sweeping(sweepmutex);
+            unique_lock<GCMutex> guard(gcmutex);
+            size_t visited = 0;
+
+            // Scan gclist once, unlinking entries as they are found.
+            // Young entries come first, so a minor sweep stops at the
+            // first old one.
+            for (p = gclist.front(); p; p = next) {
+
+                // Let other threads add entries now and then. New
+                // entries go in front of p, and only a holder of
+                // sweepmutex could remove p or the entries behind it.
+                if (++visited % SWEEP_BATCH == 0) {
+                    guard.unlock();
+                    guard.lock();
+                }
+
+                next = p->next;
+
+                if (young && p->isOld()) break;
+
+                bool unlink;
+                if (which == GCHeap::UNREFERENCED ||
+                    which == GCHeap::YOUNG_UNREFERENCED) {
+                    unlink = p->refcount == 0;
+                } else if (which == GCHeap::UNMARKED ||
+                           which == GCHeap::YOUNG_UNMARKED) {
+                    unlink = !p->marked;
+                    p->marked = false;
+                } else {
+                    // Destructors run at shutdown must not
+                    // count these entries as candidate roots
+                    p->refcount = 0;
+                    unlink = true;
+                }
+
+                // Young survivors are promoted oldest first, which keeps
+                // the young entries together. A tracing collection ages
+                // every survivor by one, and a full one promotes them all
+                // since the remembered set is emptied. Reference counting
+                // promotes the survivors behind the newest youngLimit.
+                if (!unlink) {
+                    if (which == GCHeap::UNMARKED) {
+                        p->age = GCInfoBase::TENURE;
+                    } else if (!p->isOld()) {
+                        if (which == GCHeap::YOUNG_UNMARKED) p->age++;
+                        else if (++kept > youngLimit) p->age = GCInfoBase::TENURE;
+                    }
+                    continue;
+                }
+
+                erasePtrInfo(p);
+                garbage.push_back(p);
+            }
+
+            // Anything released by the destructors of the garbage counts
+            // towards the next collection. Old garbage is left for a full
+            // sweep. In tracing mode the policy only chooses when to run
+            // a full collection, so a minor one leaves it alone.
+            if (which == GCHeap::YOUNG_UNREFERENCED) {
+                lastLiveBytes = (size_t) liveBytes;
+                pendingEntries = (size_t) pendingOldEntries;
+                pendingBytes = (size_t) pendingOldBytes;
+            } else if (which != GCHeap::YOUNG_UNMARKED) {
+                lastLiveBytes = (size_t) liveBytes;
+                pendingEntries = 0;
+                pendingBytes = 0;
+                pendingOldEntries = 0;
+                pendingOldBytes = 0;
+            }
+        }
+
+        // The cycle collector must not keep entries that are about to be freed
+        if (GCTraceable<T>::value) {
+            for (size_t i = before; i < garbage.size(); ++i) {
+                GCCycleCollector::removeRoot(garbage[i]);
+            }
+        }
+        return garbage.size() - before;
+    }
+
+    // Assign a pointer to this GCPtr without the write barrier
+    template <class T>
+    void GCPtr<T>::assign(T *t, unsigned n) {
+
+        bool added;
+
+        // First, decrement the reference count
+        // for the memory currently being pointed to
+        releasePtrInfo(info);
+
+        // Next, if te new address is already existent in the system,
+        // increment its count. Otherwise, create a new entry for gclist
+        info = acquirePtrInfo(t, added, n);
+
+        GC_TRACE(ASSIGN, info, info ? (size_t) info->refcount : 0);
+
+        if (added) maybeCollect();
+    }
+
+    // Assign a GCPtr to this GCPtr without the write barrier
+    template <class T>
+    void GCPtr<T>::assign(const GCPtr &rv) {
+
+        GCInfo<T> *old = info;
+
+        // First, increment the reference count of the new address.
+        // Doing this first keeps self-assignment from dropping it to zero.
+        info = rv.info;
+
+        #ifndef GC_TRACING
+        if (info) {
+            info->refcount++; // increment the count
+            GCMetrics::increment();
+        }
+        #endif
+
+        // Next, decrement the reference count
+        // for the memory previously being pointed to.
+        releasePtrInfo(old);
+
+        GC_TRACE(ASSIGN, info, info ? (size_t) info->refcount : 0);
+    }
+
+    // Overload move assignment of GCPtr to GCPtr. The reference held by
+    // rv is taken over, so only the entry previously pointed to is touched.
+    template <class T>
+    GCPtr<T> & GCPtr<T>::operator=(GCPtr &&rv) noexcept {
+
+        if (this == &rv) return *this;
+
+        // Drop the reference to the memory currently being pointed to.
+        // Any garbage this creates is left for the next collection.
+        releasePtrInfo(info);
+
+        info = rv.info;
+        rv.info = NULL;
+
+        GC_TRACE(ASSIGN, info, info ? (size_t) info->refcount : 0);
+
+        writeBarrier();
+
+        return *this;
+    }
+
+    // A utility function that displays gclist
+    template <class T>
+    void GCPtr<T>::showlist() {
+
+        GCInfo<T> *p;
+
+        lock_guard<GCMutex> guard(gcmutex);
+
+        cout << "gclist<" << typeid(T).name() << ">: \n";
+        cout << "memPtr     recount         value\n";
+
+        if (gclist.empty()) {
+            cout << "      -- Empty --\n\n";
+            return;
+        }
+
+        for (p = gclist.front(); p; p = p->next) {
+
+            cout << " [" << (void *)p->memPtr << "]"
+            << "        " << p->refcount << "       ";
+
+            if (p->memPtr) cout << "    " << *p->memPtr;
+            else cout << "   ---";
+            cout << endl;
+        }
+        cout << endl;
+    }
+
+    // Find a pointer in gclist.
+    template <class T>
+    GCInfo<T> *GCPtr<T>::findPtrInfo(T *ptr) {
+
+        GCMetrics::lookup();
+
+        // Look the pointer up in the index rather than scanning gclist
+        GCInfo<T> **p = gcindex.find(ptr);
+
+        if (p) return *p;
+        return NULL;
+    }
+
+    // Free every object in gclist
+    template <class T>
+    void GCPtr<T>::shutdown() {
+
+        vector<GCInfoBase *> garbage;
+
+        if (gclistSize() == 0) return; // list is empty
+
+        #ifdef DISPLAY
+            cout << "Before collecting for shutdown() for "
+            << typeid(T).name() << "\n";
+        #endif
+
+        unlinkEntries(garbage, GCHeap::ALL);
+        GCHeap::release(garbage);
+
+        #ifdef DISPLAY
+            cout << "After collecting for shutdown() for "
+            << typeid(T).name() << "\n";
+        #endif
+    }
+
+#ifdef GC_TRACING
+
+    // GCRoot is a GCPtr that the tracing collector marks from. Every
+    // GCPtr that lives on the stack or in a global must be a GCRoot.
+    // GCPtrs inside collected objects are found through gcTrace().
+    template <class T, int size = 0>
+    class GCRoot : public GCPtr<T, size>, private GCRootBase {
+
+    public:
+        // Roots are always marked, so none of these use the write barrier
+
+        GCRoot(T *t = NULL) : GCPtr<T, size>(t, NoBarrier()) {
+            GCMarkSweep::addRoot(this);
+        }
+
+        GCRoot(const GCPtr<T> &ob) : GCPtr<T, size>(ob, NoBarrier()) {
+            GCMarkSweep::addRoot(this);
+        }
+
+        GCRoot(const GCRoot &ob) : GCPtr<T, size>(ob, NoBarrier()) {
+            GCMarkSweep::addRoot(this);
+        }
+
+        ~GCRoot() {
+            GCMarkSweep::removeRoot(this);
+        }
+
+        T *operator=(T *t) {
+            this->assign(t);
+            return t;
+        }
+
+        GCRoot &operator=(const GCPtr<T> &rv) {
+            this->assign(rv);
+            return *this;
+        }
+
+        GCRoot &operator=(const GCRoot &rv) {
+            this->assign(rv);
+            return *this;
+        }
+
+    private:
+        typedef typename GCPtr<T, size>::NoBarrier NoBarrier;
+
+        GCInfoBase *rootInfo() const {
+            return this->info;
+        }
+    };
+
+#else
+
+    // Without tracing every GCPtr keeps its object alive, so a root is a GCPtr
+    template <class T, int size = 0>
+    using GCRoot = GCPtr<T, size>;
+
+#endif
+
+    // GCWeakPtr refers to an object managed by GCPtr<T> without keeping
+    // it alive, for caches and lists of observers. lock() returns a
+    // GCPtr to the object, or a null GCPtr once it has been freed. It
+    // compares the generation of the entry with the one recorded when
+    // the GCWeakPtr was made, so no gclist is searched. Only the entry
+    // is kept while GCWeakPtrs refer to it; for an object made by
+    // make_gc() that is the block holding the object.
+    template <class T>
+    class GCWeakPtr {
+
+    public:
+        GCWeakPtr() : info(NULL), generation(0) {}
+
+        GCWeakPtr(const GCPtr<T> &p) : info(NULL), generation(0) {
+            set(p.info);
+        }
+
+        GCWeakPtr(const GCWeakPtr &ob) : info(ob.info), generation(ob.generation) {
+            if (info) info->weakcount++;
+        }
+
+        GCWeakPtr(GCWeakPtr &&ob) noexcept : info(ob.info), generation(ob.generation) {
+            ob.info = NULL;
+        }
+
+        ~GCWeakPtr() {
+            reset();
+        }
+
+        GCWeakPtr &operator=(const GCPtr<T> &rv) {
+            GCWeakPtr tmp(rv);
+            swap(tmp);
+            return *this;
+        }
+
+        GCWeakPtr &operator=(GCWeakPtr rv) {
+            swap(rv);
+            return *this;
+        }
+
+        // Return a GCPtr to the object, or a null GCPtr if it is gone
+        GCPtr<T> lock() const {
+
+            GCInfo<T> *p = info ? GCPtr<T>::lockWeak(info, generation) : NULL;
+
+            if (!p) return GCPtr<T>();
+            return GCPtr<T>(p, typename GCPtr<T>::Counted());
+        }
+
+        // Return true if the object has been freed. A false result may
+        // be out of date by the time it is used; call lock() instead.
+        bool expired() const {
+            return !info || info->generation != generation;
+        }
+
+        // Stop referring to the object
+        void reset() {
+            if (info) GCPtr<T>::releaseWeak(info);
+            info = NULL;
+        }
+
+        void swap(GCWeakPtr &ob) {
+            std::swap(info, ob.info);
+            std::swap(generation, ob.generation);
+        }
+
+    private:
+        GCInfo<T> *info; // the entry of the object, or NULL
+        unsigned generation; // the generation of info when this was made
+
+        // Refer to p, which is known to be in use
+        void set(GCInfo<T> *p) {
+
+            // A null GCPtr may have an entry but never an object
+            if (!p || !p->memPtr) return;
+
+            p->weakcount++;
+            info = p;
+            generation = p->generation;
+        }
+    };
+
+    // GCReserve holds back a block of memory for when the system runs
+    // out. make_gc() frees it if an allocation still fails after a
+    // collection, so the program can go on and release what it can.
+    // Call set() again to refill it.
+    class GCReserve {
+
+    public:
+
+        // Hold a reserve of bytes, replacing any reserve held now.
+        // Return false if the memory could not be had.
+        static bool set(size_t bytes) {
+
+            State &s = state();
+            lock_guard<GCMutex> guard(s.mutex);
+
+            ::operator delete(s.mem);
+            s.mem = bytes ? ::operator new(bytes, nothrow) : NULL;
+            s.bytes = s.mem ? bytes : 0;
+            return s.mem != NULL || bytes == 0;
+        }
+
+        // Return the size of the reserve held
+        static size_t size() {
+
+            State &s = state();
+            lock_guard<GCMutex> guard(s.mutex);
+
+            return s.bytes;
+        }
+
+        // Give the reserve back to the system. Return false
+        // if there was none.
+        static bool release() {
+
+            State &s = state();
+            lock_guard<GCMutex> guard(s.mutex);
+
+            if (!s.mem) return false;
+
+            ::operator delete(s.mem);
+            s.mem = NULL;
+            s.bytes = 0;
+            return true;
+        }
+
+    private:
+
+        struct State {
+            void *mem; // the reserve, or NULL
+            size_t bytes; // its size
+            GCMutex mutex; // guards the above
+
+            State() : mem(NULL), bytes(0) {}
+        };
+
+        static State &state() {
+            return GCSingleton<State>::get();
+        }
+    };
+
+    namespace gc {
+
+    // Collect the garbage of every GCPtr type in one pass.
+    // Return the number of objects freed.
+    inline size_t collect_all() {
+
+        #ifdef GC_TRACING
+        return GCMarkSweep::collect();
+        #else
+        vector<GCInfoBase *> garbage;
+        size_t freed = 0, pass;
+
+        // The sweeps and the cycle passes make up one collection
+        GCMetrics::Pause pause;
+
+        // The destructors of freed objects may drop the last references
+        // to others, so repeat until a pass frees nothing
+        do {
+            GCHeap::unlinkAll(garbage, GCHeap::UNREFERENCED);
+            GCHeap::release(garbage);
+
+            pass = garbage.size();
+            garbage.clear();
+
+            #ifndef GC_THREAD_SAFE
+            // Cycles are only reclaimed by trial deletion
+            pass += GCCycleCollector::collect();
+            #endif
+
+            freed += pass;
+        } while (pass > 0);
+
+        return freed;
+        #endif
+    }
+
+    // Return alloc(). If it throws bad_alloc, collect the garbage of
+    // every GCPtr type and try again, then give back the emergency
+    // reserve and try once more, so running out of memory costs a
+    // pause before it becomes an exception.
+    template <class Alloc>
+    auto allocate(Alloc alloc) -> decltype(alloc()) {
+
+        try {
+            return alloc();
+        } catch (bad_alloc &) {
+        }
+
+        if (collect_all() > 0) {
+            try {
+                return alloc();
+            } catch (bad_alloc &) {
+            }
+        }
+
+        if (!GCReserve::release()) throw bad_alloc();
+        return alloc();
+    }
+
+    }
+
+    // Create a T from args and return a GCPtr to it. The object and
+    // its gclist entry are placed in a single allocation. If memory
+    // runs out, garbage is collected and the allocation retried.
+    template <class T, class... Args>
+    GCPtr<T> make_gc(Args &&... args) {
+
+        #ifdef GC_TRACING
+        // Collect now, since the new object is not reachable until it is returned
+        GCPtr<T>::collectBeforeAdding();
+        #endif
+
+        GCInfo<T> *p = gc::allocate([] {
+            return GCInfo<T>::allocateBlock(1, false);
+        });
+
+        #ifdef GC_TRACING
+        // The block is not in gclist yet, so collecting while allocating
+        // it was safe. The GCPtrs the constructor makes are not.
+        GCMarkSweep::Construction constructing;
+        #endif
+
+        try {
+            new ((void *) p->memPtr) T(std::forward<Args>(args)...);
+        } catch (...) {
+            GCInfo<T>::deallocateBlock(p);
+            throw;
+        }
+        return GCPtr<T>(p, typename GCPtr<T>::NewEntry());
+    }
+
+    // Create an array of n value-initialized objects of type T and return
+    // a GCPtr to it. The array and its gclist entry share one allocation.
+    template <class T>
+    GCPtr<T> make_gc_array(unsigned n) {
+
+        #ifdef GC_TRACING
+        GCPtr<T>::collectBeforeAdding();
+        #endif
+
+        GCInfo<T> *p = gc::allocate([n] {
+            return GCInfo<T>::allocateBlock(n, true);
+        });
+
+        #ifdef GC_TRACING
+        GCMarkSweep::Construction constructing;
+        #endif
+        unsigned i = 0;
+
+        try {
+            for (; i < n; ++i) new ((void *) (p->memPtr + i)) T();
+        } catch (...) {
+            // Undo the elements constructed so far
+            while (i > 0) p->memPtr[--i].~T();
+            GCInfo<T>::deallocateBlock(p);
+            throw;
+        }
+        return GCPtr<T>(p, typename GCPtr<T>::NewEntry());
     }
 
 #endif //GARBAGECOLLECTOR_GC_H
@@ -0,0 +1,283 @@
+/*
+ * Parallel algorithms over arrays managed by GCPtr, run on a pool of
+ * threads that steal work from each other.
+ */
+
+#ifndef GARBAGECOLLECTOR_GC_PARALLEL_H
+#define GARBAGECOLLECTOR_GC_PARALLEL_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "gc.h"
+
+// GCThreadPool runs tasks on one thread per core, less one for the
+// thread that starts the work. Each thread has a queue of its own,
+// takes its work from the back of it and, once it is empty, steals
+// from the front of the others. A thread waiting for its work to
+// finish runs tasks meanwhile, so work may start more work.
+//
+// Worker threads see only the memory of an array, never a GCPtr, so
+// the pool can be used without GC_THREAD_SAFE as long as the functions
+// it runs do not touch GCPtrs themselves.
+class GCThreadPool {
+
+public:
+
+    // Return the pool shared by the parallel algorithms
+    static GCThreadPool &instance() {
+        static GCThreadPool *pool = new GCThreadPool(requested());
+        return *pool;
+    }
+
+    // Choose the number of worker threads. Only a call made
+    // before the pool is first used has any effect.
+    static void setWorkers(unsigned n) {
+        requested() = n;
+    }
+
+    // Return the number of worker threads
+    unsigned workers() const {
+        return (unsigned) threads.size();
+    }
+
+    // Call body(begin, end) on consecutive ranges of [0, n), each of
+    // grain elements except perhaps the last, and return once all have
+    // returned. The first exception thrown by body is rethrown here.
+    void parallelFor(size_t n, size_t grain,
+                     const function<void(size_t, size_t)> &body) {
+
+        if (n == 0) return;
+        if (grain == 0) grain = 1;
+
+        size_t chunks = (n + grain - 1) / grain;
+
+        // Too little work to be worth handing out
+        if (chunks == 1 || queues.empty()) {
+            body(0, n);
+            return;
+        }
+
+        Job job(body, chunks);
+
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t begin = c * grain;
+            size_t end = begin + grain < n ? begin + grain : n;
+            push(c % queues.size(), Task(&job, begin, end));
+        }
+
+        // Notify while holding sleepMutex, so a worker that has just
+        // found no work either sees the tasks or is already waiting
+        {
+            lock_guard<mutex> guard(sleepMutex);
+            wake.notify_all();
+        }
+
+        // Help until every chunk is done
+        while (job.remaining.load(memory_order_acquire) > 0) {
+            if (!runOne(next++ % queues.size())) this_thread::yield();
+        }
+
+        if (job.error) rethrow_exception(job.error);
+    }
+
+private:
+
+    // A call to parallelFor()
+    struct Job {
+        const function<void(size_t, size_t)> &body;
+        atomic<size_t> remaining; // chunks not yet done
+        exception_ptr error; // the first exception thrown by body
+        mutex errorMutex; // guards error
+
+        Job(const function<void(size_t, size_t)> &b, size_t chunks)
+                : body(b), remaining(chunks) {}
+    };
+
+    // One chunk of a job
+    struct Task {
+        Job *job;
+        size_t begin, end;
+
+        Task(Job *j = NULL, size_t b = 0, size_t e = 0) : job(j), begin(b), end(e) {}
+    };
+
+    struct Queue {
+        deque<Task> tasks;
+        mutex lock; // guards tasks
+    };
+
+    vector<Queue *> queues; // one per worker
+    vector<thread> threads;
+    atomic<size_t> queued; // tasks in all queues
+    atomic<unsigned> next; // where a helping thread looks first
+    mutex sleepMutex;
+    condition_variable wake; // signalled when tasks are pushed
+
+    explicit GCThreadPool(unsigned n) : queued(0), next(0) {
+
+        for (unsigned i = 0; i < n; ++i) queues.push_back(new Queue);
+        for (unsigned i = 0; i < n; ++i) threads.push_back(thread(&GCThreadPool::work, this, i));
+
+        // The pool is never destroyed, so its threads
+        // wait for work until the program exits
+        for (unsigned i = 0; i < n; ++i) threads[i].detach();
+    }
+
+    // The number of workers to start, one per core less one by default
+    static unsigned &requested() {
+        static unsigned cores = thread::hardware_concurrency();
+        static unsigned n = cores > 1 ? cores - 1 : 0;
+        return n;
+    }
+
+    void push(size_t q, const Task &t) {
+        {
+            lock_guard<mutex> guard(queues[q]->lock);
+            queues[q]->tasks.push_back(t);
+        }
+        queued.fetch_add(1, memory_order_release);
+    }
+
+    // Take a task from the back of queue self, or else steal one from
+    // the front of another queue
+    bool take(size_t self, Task &t) {
+
+        if (queued.load(memory_order_acquire) == 0) return false;
+
+        for (size_t i = 0; i < queues.size(); ++i) {
+
+            size_t q = (self + i) % queues.size();
+            lock_guard<mutex> guard(queues[q]->lock);
+            deque<Task> &tasks = queues[q]->tasks;
+
+            if (tasks.empty()) continue;
+
+            if (i == 0) {
+                t = tasks.back();
+                tasks.pop_back();
+            } else {
+                t = tasks.front();
+                tasks.pop_front();
+            }
+            queued.fetch_sub(1, memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Run one task, if there is one. Return false if there was none.
+    bool runOne(size_t self) {
+
+        Task t;
+        if (!take(self, t)) return false;
+
+        try {
+            t.job->body(t.begin, t.end);
+        } catch (...) {
+            lock_guard<mutex> guard(t.job->errorMutex);
+            if (!t.job->error) t.job->error = current_exception();
+        }
+
+        t.job->remaining.fetch_sub(1, memory_order_release);
+        return true;
+    }
+
+    // The body of worker thread self
+    void work(unsigned self) {
+
+        for (;;) {
+            if (runOne(self)) continue;
+
+            // Sleep until parallelFor() pushes tasks
+            unique_lock<mutex> guard(sleepMutex);
+            wake.wait(guard, [this] {
+                return queued.load(memory_order_acquire) > 0;
+            });
+        }
+    }
+};
+
+namespace gc {
+
+    // Return the number of elements each task should take for an
+    // array of n, so that every thread gets several tasks
+    inline size_t grainFor(size_t n) {
+
+        size_t threads = GCThreadPool::instance().workers() + 1;
+        size_t grain = n / (threads * 8);
+
+        return grain < 1024 ? 1024 : grain;
+    }
+
+    // Call f on every element of the array a points to, in parallel.
+    // The array is kept alive until f has been called on all of it.
+    template <class T, int size, class F>
+    void parallel_for_each(const GCPtr<T, size> &a, F f) {
+
+        GCRoot<T, size> keep(a);
+        GCSpan<T> s = keep.span();
+        T *data = s.data();
+
+        GCThreadPool::instance().parallelFor(s.size(), grainFor(s.size()),
+            [data, &f](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) f(data[i]);
+            });
+    }
+
+    // Store f(in[i]) in out[i] for every element of in, in parallel.
+    // Throws OutOfRangeExc if out is shorter than in.
+    template <class T, int size, class U, int usize, class F>
+    void parallel_transform(const GCPtr<T, size> &in, const GCPtr<U, usize> &out, F f) {
+
+        GCRoot<T, size> keepIn(in);
+        GCRoot<U, usize> keepOut(out);
+
+        GCSpan<T> from = keepIn.span();
+        GCSpan<U> to = keepOut.span(0, from.size());
+        T *src = from.data();
+        U *dst = to.data();
+
+        GCThreadPool::instance().parallelFor(from.size(), grainFor(from.size()),
+            [src, dst, &f](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) dst[i] = f(src[i]);
+            });
+    }
+
+    // Combine init and every element of the array a points to with op,
+    // in parallel. op must be associative. Each task folds its part of
+    // the array from left to right, and the parts are then folded into
+    // init in order, so the result does not depend on the scheduling.
+    template <class T, int size, class R, class Op>
+    R parallel_reduce(const GCPtr<T, size> &a, R init, Op op) {
+
+        GCRoot<T, size> keep(a);
+        GCSpan<T> s = keep.span();
+        T *data = s.data();
+
+        size_t n = s.size();
+        if (n == 0) return init;
+
+        size_t grain = grainFor(n);
+        vector<R> parts((n + grain - 1) / grain, init);
+
+        GCThreadPool::instance().parallelFor(n, grain,
+            [data, grain, &parts, &op](size_t begin, size_t end) {
+                R part = data[begin];
+                for (size_t i = begin + 1; i < end; ++i) part = op(part, data[i]);
+                parts[begin / grain] = part;
+            });
+
+        for (size_t i = 0; i < parts.size(); ++i) init = op(init, parts[i]);
+        return init;
+    }
+
+}
+
+#endif //GARBAGECOLLECTOR_GC_PARALLEL_H